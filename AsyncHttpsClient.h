@@ -1,18 +1,68 @@
 #pragma once
 #include <Arduino.h>
+#include <stdarg.h>
+#include <functional>
+#include <memory>
+#include <new>
 
 #if defined(ESP8266)
   #include <ESP8266WiFi.h>
   #include <WiFiClientSecureBearSSL.h>
+  #include <lwip/dns.h>
   #include <time.h>
   using SecureClientT = BearSSL::WiFiClientSecure;
+  #define ASYNC_HTTPSCLIENT_LWIP_DNS 1
 #elif defined(ESP32)
   #include <WiFi.h>
   #include <WiFiClientSecure.h>
+  #include <lwip/dns.h>
+  #include <lwip/tcpip.h>
   #include <time.h>
   using SecureClientT = WiFiClientSecure;
+  #define ASYNC_HTTPSCLIENT_LWIP_DNS 1
 #else
-  #error "AsyncHttpsClient supports only ESP8266 or ESP32"
+  // Host build: Arduino.h comes from extras/host and the transport is chosen
+  // by the application, e.g. BasicAsyncHttpsClient<PosixTlsTransport>.
+  #include <time.h>
+  #define ASYNC_HTTPSCLIENT_LWIP_DNS 0
+#endif
+
+// Scratch buffer for header lines (also the longest accepted header line).
+#ifndef ASYNC_HTTPSCLIENT_RX_BUFFER
+#define ASYNC_HTTPSCLIENT_RX_BUFFER 512
+#endif
+
+// Concurrent asynchronous DNS lookups shared by all clients (static storage).
+#ifndef ASYNC_HTTPSCLIENT_DNS_SLOTS
+#define ASYNC_HTTPSCLIENT_DNS_SLOTS 2
+#endif
+
+// TLS sessions remembered per client for abbreviated handshakes.
+#ifndef ASYNC_HTTPSCLIENT_TLS_SESSIONS
+#define ASYNC_HTTPSCLIENT_TLS_SESSIONS 2
+#endif
+
+// Connections owned by an AsyncHttpsPool.
+#ifndef ASYNC_HTTPSCLIENT_POOL_SIZE
+#define ASYNC_HTTPSCLIENT_POOL_SIZE 3
+#endif
+
+// Hosts tracked by AsyncHttpsStats, the last one shared by all others (>= 1).
+#ifndef ASYNC_HTTPSCLIENT_STATS_HOSTS
+#define ASYNC_HTTPSCLIENT_STATS_HOSTS 4
+#endif
+
+// AsyncHttpsScheduler: requests in flight at once, and queued requests.
+#ifndef ASYNC_HTTPSCLIENT_SCHED_WORKERS
+#define ASYNC_HTTPSCLIENT_SCHED_WORKERS 2
+#endif
+#ifndef ASYNC_HTTPSCLIENT_SCHED_QUEUE
+#define ASYNC_HTTPSCLIENT_SCHED_QUEUE 8
+#endif
+
+// Buffer for bodies streamed through onRequestBodyChunk() (allocated on first use).
+#ifndef ASYNC_HTTPSCLIENT_TX_BUFFER
+#define ASYNC_HTTPSCLIENT_TX_BUFFER 512
 #endif
 
 #ifndef ASYNC_HTTPSCLIENT_DEBUG
@@ -28,23 +78,624 @@
 #define AHC_DEBUG(...) do {} while (0)
 #endif
 
-class AsyncHttpsClient {
+// -------- Transport --------
+// The client talks to the network only through a Transport policy class:
+//
+//   using Session = ...;                 // plain bytes (copied into WarmState)
+//   static const bool kResumesSessions;  // Session is worth caching
+//   static const bool kConnectByIp;      // connect() uses AhcTlsParams::ip
+//   static const bool kOneSocketTimeout; // connectTimeoutMs is not separate
+//   AhcConnect connect(const AhcTlsParams&, Session* session);
+//   bool     sessionResumed() const;     // last connect() was abbreviated
+//   uint16_t tcpConnectMs() const;       // TCP part of the last connect() (0 = unknown)
+//   bool     saveSession(Session& out);  // refresh out from the live connection
+//   uint8_t  connected();
+//   int      available();
+//   int      read(uint8_t* dst, size_t len);
+//   size_t   write(const uint8_t* data, size_t len);
+//   int      availableForWrite();        // 0: no room now, < 0: unknown
+//   void     stop();
+//   int      lastError(char* buf, size_t len);  // 0 = none
+//
+// connect() is called again on every poll() while it returns PENDING. It
+// returns TCP_TIMEOUT or TLS_TIMEOUT only when it knows that budget ran out;
+// any other failure is FAILED.
+// EspTransport wraps the core's secure client; extras/host has a POSIX +
+// OpenSSL transport and an in-memory mock.
+enum class AhcConnect : uint8_t { FAILED, DONE, PENDING, TCP_TIMEOUT, TLS_TIMEOUT };
+
+struct AhcTlsParams {
+  const char* host;
+  uint16_t    port;
+  uint32_t    ip;        // IPv4, network byte order; 0 = resolve host
+  const char* caPem;
+  time_t      now;       // unix time for certificate validity
+  uint16_t    connectTimeoutMs;
+  uint16_t    handshakeTimeoutMs;
+};
+
+#if defined(ESP8266) || defined(ESP32)
+// Secure client of the core: BearSSL on ESP8266, mbedTLS on ESP32. Both
+// connect() calls block until the handshake is done.
+//
+// Neither core tells a timed-out connect from a refused one, so connect()
+// reports every failure as FAILED.
+class EspTransport {
+public:
+#if defined(ESP8266)
+  using Session = BearSSL::Session;
+  static const bool kResumesSessions = true;
+  static const bool kConnectByIp = false;
+  static const bool kOneSocketTimeout = true;  // one Stream timeout covers connect + handshake
+#else
+  struct Session {};
+  static const bool kResumesSessions = false;
+  static const bool kConnectByIp = true;
+  static const bool kOneSocketTimeout = false;
+#endif
+
+  AhcConnect connect(const AhcTlsParams& p, Session* session) {
+#if defined(ESP8266)
+    _ta = anchorsFor(p.caPem);
+    _c.setBufferSizes(512, 512); // reasonable defaults
+    _c.setTimeout(p.handshakeTimeoutMs); // ms: bounds connect and handshake
+    _c.setX509Time(p.now); // critical for cert validity checks
+    _c.setTrustAnchors(_ta.get());
+    // BearSSL offers the cached session ID and falls back to a full handshake
+    // if the server declines; an unchanged session after connect() means the
+    // server accepted it.
+    Session offered;
+    if (session) offered = *session;
+    _c.setSession(session);
+    bool ok = _c.connect(p.host, p.port);
+    _resumed = ok && session && memcmp(&offered, session, sizeof(offered)) == 0;
+#else
+    (void)session;
+    _c.setTimeout((p.connectTimeoutMs + 999) / 1000);  // seconds
+    _c.setHandshakeTimeout((p.handshakeTimeoutMs + 999) / 1000);
+    _c.setCACert(p.caPem);
+    // Connect to the address we already have; the name still drives SNI and
+    // certificate verification.
+    bool ok = p.ip ? _c.connect(IPAddress(p.ip), p.port, p.host, p.caPem, nullptr, nullptr)
+                   : _c.connect(p.host, p.port);
+#endif
+    return ok ? AhcConnect::DONE : AhcConnect::FAILED;
+  }
+
+#if defined(ESP8266)
+  bool sessionResumed() const { return _resumed; }
+#else
+  bool sessionResumed() const { return false; }
+#endif
+  uint16_t tcpConnectMs() const { return 0; }  // connect() does TCP and TLS in one call
+  bool saveSession(Session&) { return false; }  // BearSSL fills it during connect()
+
+  uint8_t connected() { return _c.connected(); }
+  int available() { return _c.available(); }
+  size_t write(const uint8_t* data, size_t len) { return _c.write(data, len); }
+  void stop() { _c.stop(); }
+
+#if defined(ESP8266)
+  int read(uint8_t* dst, size_t len) { return _c.readBytes((char*)dst, len); }
+  int availableForWrite() { return _c.availableForWrite(); }
+  int lastError(char* buf, size_t len) { return _c.getLastSSLError(buf, len); }
+#else
+  int read(uint8_t* dst, size_t len) { return _c.read(dst, len); }
+  int availableForWrite() { return -1; }
+  int lastError(char* buf, size_t len) { return _c.lastError(buf, len); }
+#endif
+
+  // The underlying client, for core-specific settings.
+  SecureClientT& client() { return _c; }
+
+private:
+  SecureClientT _c;
+#if defined(ESP8266)
+  // X509List copies/parses the PEM; connections using the same CA share one.
+  static std::shared_ptr<BearSSL::X509List> anchorsFor(const char* pem) {
+    static const char* cachedPem = nullptr;
+    static std::weak_ptr<BearSSL::X509List> cached;
+    std::shared_ptr<BearSSL::X509List> ta = cached.lock();
+    if (ta && cachedPem == pem) return ta;
+    ta = std::make_shared<BearSSL::X509List>(pem);
+    cached = ta;
+    cachedPem = pem;
+    return ta;
+  }
+
+  std::shared_ptr<BearSSL::X509List> _ta;
+  bool _resumed = false;
+#endif
+};
+#endif
+
+// -------- Statistics --------
+// Where the time of one request went, in ms. Stages a request skipped (DNS
+// and connect on a kept-alive socket) stay 0; on error the failing stage
+// holds the time until the failure. 16-bit fields saturate at 65535.
+struct AhcTimings {
+  uint16_t dnsMs;
+  uint16_t tcpMs;      // 0 if the transport connects and handshakes in one call
+  uint16_t tlsMs;      // TLS handshake (all of the connect when tcpMs is 0)
+  uint16_t sendMs;     // writing the request
+  uint16_t ttfbMs;     // request written -> first response byte
+  uint16_t headersMs;  // first byte -> end of headers
+  uint32_t bodyMs;
+  uint32_t totalMs;    // begin*() -> done() / error()
+  uint32_t bytesIn;    // response bytes read, headers included
+  uint32_t bytesOut;   // request bytes written
+  bool     reused;     // sent on a kept-alive connection
+  bool     newConnection;  // opened (and handshook) a connection: tcpMs/tlsMs
+};
+
+// Log-bucketed histogram of 0..65535 ms, HDR-style: 4 buckets per power of
+// two, so a percentile is within 25% of the exact value. Bucket counts
+// saturate at 65535; export and reset before that.
+class AhcHistogram {
+public:
+  static const uint8_t kSubBits = 2;
+  static const uint8_t kBuckets = (16 - kSubBits + 1) << kSubBits;  // 60
+
+  void record(uint32_t ms) {
+    if (ms > 0xFFFF) ms = 0xFFFF;
+    uint16_t& c = _counts[bucketOf(ms)];
+    if (c < 0xFFFF) c++;
+    _count++;
+    _sumMs += ms;
+    if (ms > _maxMs) _maxMs = (uint16_t)ms;
+  }
+
+  uint32_t count() const { return _count; }
+  uint32_t sumMs() const { return _sumMs; }
+  uint16_t maxMs() const { return _maxMs; }
+  uint16_t bucket(uint8_t i) const { return _counts[i]; }
+
+  // Smallest bucket bound at or above the q-quantile (q in 0..1), capped at
+  // the largest value seen. 0 when empty.
+  uint32_t percentile(float q) const {
+    uint32_t total = 0;
+    for (uint16_t c : _counts) total += c;
+    if (total == 0) return 0;
+    uint32_t rank = (uint32_t)(q * total + 0.999f);
+    if (rank < 1) rank = 1;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < kBuckets; i++) {
+      seen += _counts[i];
+      if (seen >= rank) return min<uint32_t>(bucketHigh(i), _maxMs);
+    }
+    return _maxMs;
+  }
+
+  void reset() { *this = AhcHistogram(); }
+
+  static uint8_t bucketOf(uint32_t ms) {
+    if (ms < (1u << kSubBits)) return (uint8_t)ms;
+    uint8_t e = 31 - __builtin_clz(ms);
+    return (uint8_t)(((e - kSubBits + 1) << kSubBits) + (ms >> (e - kSubBits)) - (1u << kSubBits));
+  }
+  static uint32_t bucketLow(uint8_t i) {
+    if (i < (1u << kSubBits)) return i;
+    uint8_t e = (i >> kSubBits) + kSubBits - 1;
+    return ((1u << kSubBits) + (i & ((1u << kSubBits) - 1))) << (e - kSubBits);
+  }
+  static uint32_t bucketHigh(uint8_t i) {
+    return i + 1 < kBuckets ? bucketLow(i + 1) - 1 : 0xFFFF;
+  }
+
+private:
+  uint16_t _counts[kBuckets] = {};
+  uint32_t _count = 0;
+  uint32_t _sumMs = 0;
+  uint16_t _maxMs = 0;
+};
+
+// Aggregate request statistics keyed by host, in a fixed table of
+// ASYNC_HTTPSCLIENT_STATS_HOSTS entries; when it is full, further hosts are
+// counted together under "*". Clients add to it through setStats(). It is
+// plain data: copying it is a snapshot.
+class AsyncHttpsStats {
+public:
+  // Indexed by the client's State: DNS_RESOLVE = 1 ... READ_BODY = 5.
+  static const uint8_t kStages = 8;
+
+  struct HostStats {
+    char     host[32];            // truncated; "" = free
+    uint32_t requests;            // finished, ok or not
+    uint32_t failures[kStages];   // by errorStage()
+    uint32_t reused;              // sent on a kept-alive connection
+    uint32_t connects;            // new connections opened
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    AhcHistogram totalMs;         // successful requests
+    AhcHistogram handshakeMs;     // new connections, TCP + TLS
+    AhcHistogram ttfbMs;          // requests that got a response byte
+  };
+
+  // One finished request; failedStage is errorStage() when !ok.
+  void record(const char* host, const AhcTimings& t, bool ok, uint8_t failedStage) {
+    HostStats* h = slotFor(host);
+    h->requests++;
+    if (!ok && failedStage < kStages) h->failures[failedStage]++;
+    if (t.reused) h->reused++;
+    if (t.newConnection) {
+      h->connects++;
+      h->handshakeMs.record((uint32_t)t.tcpMs + t.tlsMs);
+    }
+    h->bytesIn += t.bytesIn;
+    h->bytesOut += t.bytesOut;
+    if (t.bytesIn > 0) h->ttfbMs.record(t.ttfbMs);
+    if (ok) h->totalMs.record(t.totalMs);
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    while (n < ASYNC_HTTPSCLIENT_STATS_HOSTS && _hosts[n].host[0]) n++;
+    return n;
+  }
+  const HostStats& at(size_t i) const { return _hosts[i]; }
+  const HostStats* find(const char* host) const {
+    for (const auto& h : _hosts) {
+      if (h.host[0] && strncmp(h.host, host, sizeof(h.host) - 1) == 0) return &h;
+    }
+    return nullptr;
+  }
+
+  void reset() {
+    for (auto& h : _hosts) h = HostStats();
+  }
+
+  // Copy everything into out and start counting from zero.
+  void takeSnapshot(AsyncHttpsStats& out) {
+    out = *this;
+    reset();
+  }
+
+  // Prometheus text format: counters and p50/p90/p99 summaries per host.
+  // Like snprintf(): writes at most cap bytes including the NUL and returns
+  // the full length, so a call with cap 0 sizes the buffer.
+  size_t toPrometheus(char* buf, size_t cap) const {
+    Out o{buf, cap, 0};
+    size_t n = size();
+    o.put("# TYPE ahc_requests_total counter\n");
+    for (size_t i = 0; i < n; i++) {
+      o.put("ahc_requests_total{host=\"%s\"} %lu\n", _hosts[i].host, (unsigned long)_hosts[i].requests);
+    }
+    o.put("# TYPE ahc_failures_total counter\n");
+    for (size_t i = 0; i < n; i++) {
+      for (uint8_t s = 0; s < kStages; s++) {
+        if (!_hosts[i].failures[s]) continue;
+        o.put("ahc_failures_total{host=\"%s\",stage=\"%s\"} %lu\n", _hosts[i].host, stageName(s),
+              (unsigned long)_hosts[i].failures[s]);
+      }
+    }
+    o.put("# TYPE ahc_connections_total counter\n");
+    for (size_t i = 0; i < n; i++) {
+      o.put("ahc_connections_total{host=\"%s\",kind=\"new\"} %lu\n", _hosts[i].host,
+            (unsigned long)_hosts[i].connects);
+      o.put("ahc_connections_total{host=\"%s\",kind=\"reused\"} %lu\n", _hosts[i].host,
+            (unsigned long)_hosts[i].reused);
+    }
+    o.put("# TYPE ahc_bytes_total counter\n");
+    for (size_t i = 0; i < n; i++) {
+      o.put("ahc_bytes_total{host=\"%s\",dir=\"in\"} %lu\n", _hosts[i].host, (unsigned long)_hosts[i].bytesIn);
+      o.put("ahc_bytes_total{host=\"%s\",dir=\"out\"} %lu\n", _hosts[i].host, (unsigned long)_hosts[i].bytesOut);
+    }
+    putSummary(o, "ahc_request_ms", &HostStats::totalMs);
+    putSummary(o, "ahc_handshake_ms", &HostStats::handshakeMs);
+    putSummary(o, "ahc_ttfb_ms", &HostStats::ttfbMs);
+    return o.len;
+  }
+
+  // Compact binary form that keeps the full histograms, for merging on a
+  // server. Little-endian; v = LEB128 varint:
+  //   "AHS" 1 | kSubBits | kBuckets | host count
+  //   per host: name length, name, v requests, v reused, v connects,
+  //             v bytesIn, v bytesOut, failure stage mask, v count per set bit,
+  //             3 histograms (total, handshake, ttfb): v count, v sumMs,
+  //             v maxMs, non-empty buckets, then (bucket index, v count) each
+  // Returns the full length; writes nothing unless it fits in cap.
+  size_t toBinary(uint8_t* buf, size_t cap) const {
+    Bin sizing{nullptr, 0, 0};
+    writeBinary(sizing);
+    if (sizing.len <= cap) {
+      Bin b{buf, cap, 0};
+      writeBinary(b);
+    }
+    return sizing.len;
+  }
+
+private:
+  struct Out {
+    char* buf;
+    size_t cap;
+    size_t len;
+    void put(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+      va_list ap;
+      va_start(ap, fmt);
+      int n = vsnprintf(len < cap ? buf + len : nullptr, len < cap ? cap - len : 0, fmt, ap);
+      va_end(ap);
+      if (n > 0) len += n;
+    }
+  };
+
+  struct Bin {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    void byte(uint8_t v) {
+      if (len < cap) buf[len] = v;
+      len++;
+    }
+    void raw(const void* p, size_t n) {
+      for (size_t i = 0; i < n; i++) byte(((const uint8_t*)p)[i]);
+    }
+    void var(uint32_t v) {
+      while (v >= 0x80) {
+        byte((uint8_t)(v | 0x80));
+        v >>= 7;
+      }
+      byte((uint8_t)v);
+    }
+  };
+
+  void writeBinary(Bin& b) const {
+    size_t n = size();
+    b.raw("AHS\1", 4);
+    b.byte(AhcHistogram::kSubBits);
+    b.byte(AhcHistogram::kBuckets);
+    b.byte((uint8_t)n);
+    for (size_t i = 0; i < n; i++) {
+      const HostStats& h = _hosts[i];
+      uint8_t len = (uint8_t)strlen(h.host);
+      b.byte(len);
+      b.raw(h.host, len);
+      b.var(h.requests);
+      b.var(h.reused);
+      b.var(h.connects);
+      b.var(h.bytesIn);
+      b.var(h.bytesOut);
+      uint8_t mask = 0;
+      for (uint8_t s = 0; s < kStages; s++) {
+        if (h.failures[s]) mask |= 1 << s;
+      }
+      b.byte(mask);
+      for (uint8_t s = 0; s < kStages; s++) {
+        if (h.failures[s]) b.var(h.failures[s]);
+      }
+      putHistogram(b, h.totalMs);
+      putHistogram(b, h.handshakeMs);
+      putHistogram(b, h.ttfbMs);
+    }
+  }
+
+  static const char* stageName(uint8_t s) {
+    static const char* const names[kStages] = {"IDLE", "DNS_RESOLVE", "CONNECT", "SEND",
+                                               "READ_HEADERS", "READ_BODY", "DONE", "ERROR"};
+    return names[s];
+  }
+
+  void putSummary(Out& o, const char* name, AhcHistogram HostStats::*hist) const {
+    static const float q[] = {0.5f, 0.9f, 0.99f};
+    static const char* const label[] = {"0.5", "0.9", "0.99"};
+    o.put("# TYPE %s summary\n", name);
+    for (size_t i = 0, n = size(); i < n; i++) {
+      const AhcHistogram& h = _hosts[i].*hist;
+      for (uint8_t k = 0; k < 3; k++) {
+        o.put("%s{host=\"%s\",quantile=\"%s\"} %lu\n", name, _hosts[i].host, label[k],
+              (unsigned long)h.percentile(q[k]));
+      }
+      o.put("%s_sum{host=\"%s\"} %lu\n", name, _hosts[i].host, (unsigned long)h.sumMs());
+      o.put("%s_count{host=\"%s\"} %lu\n", name, _hosts[i].host, (unsigned long)h.count());
+    }
+  }
+
+  static void putHistogram(Bin& b, const AhcHistogram& h) {
+    b.var(h.count());
+    b.var(h.sumMs());
+    b.var(h.maxMs());
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < AhcHistogram::kBuckets; i++) used += h.bucket(i) != 0;
+    b.byte(used);
+    for (uint8_t i = 0; i < AhcHistogram::kBuckets; i++) {
+      if (!h.bucket(i)) continue;
+      b.byte(i);
+      b.var(h.bucket(i));
+    }
+  }
+
+  // The host's entry; a new one while there is room, else the shared "*".
+  HostStats* slotFor(const char* host) {
+    const size_t last = ASYNC_HTTPSCLIENT_STATS_HOSTS - 1;
+    for (size_t i = 0; i < last; i++) {
+      HostStats& h = _hosts[i];
+      if (!h.host[0]) {
+        strncpy(h.host, host, sizeof(h.host) - 1);
+        return &h;
+      }
+      if (strncmp(h.host, host, sizeof(h.host) - 1) == 0) return &h;
+    }
+    HostStats& other = _hosts[last];
+    if (!other.host[0]) other.host[0] = '*';
+    return &other;
+  }
+
+  HostStats _hosts[ASYNC_HTTPSCLIENT_STATS_HOSTS] = {};
+};
+
+// Keep-alive TLS connections shared by several AsyncHttpsClient instances,
+// keyed by host:port. A request takes an idle connection to its host when
+// there is one; otherwise a free slot, or the least recently used idle
+// connection is closed to make room. The pool must outlive its clients.
+template <class Transport>
+class BasicAsyncHttpsPool {
+public:
+  struct Options {
+    uint8_t  maxPerHost  = 1;  // connections (busy + idle) per host:port
+    uint32_t minFreeHeap = 0;  // close idle connections while free heap is below this
+  };
+
+  void setOptions(const Options& opt) { _opt = opt; }
+
+  // A connection for host:port, marked busy. Already connected when an idle
+  // one was reused; nullptr when the host is at maxPerHost or every slot is
+  // busy (try again later).
+  Transport* acquire(const String& host, uint16_t port) {
+    size_t perHost = 0;
+    for (auto& s : _slots) {
+      if (s.port != port || s.host != host) continue;
+      if (s.busy) {
+        perHost++;
+        continue;
+      }
+      if (s.client.connected() && millis() - s.lastUse < s.idleMs) {
+        s.busy = true;
+        _hits++;
+        AHC_DEBUG("POOL: reusing %s:%u", host.c_str(), port);
+        return &s.client;
+      }
+      clear(s);  // closed by the server, or idle past its keep-alive window
+    }
+    if (perHost >= _opt.maxPerHost) return nullptr;
+
+    trim();
+    Slot* pick = nullptr;
+    for (auto& s : _slots) {
+      if (s.busy) continue;
+      if (s.host.length() == 0) {
+        pick = &s;
+        break;
+      }
+      if (!pick || s.lastUse < pick->lastUse) pick = &s;
+    }
+    if (!pick) return nullptr;
+    if (pick->host.length() > 0) {
+      AHC_DEBUG("POOL: evicting %s:%u", pick->host.c_str(), pick->port);
+      clear(*pick);
+      _evictions++;
+    }
+    pick->host = host;
+    pick->port = port;
+    pick->busy = true;
+    _misses++;
+    return &pick->client;
+  }
+
+  // Hand a connection back; keep=false closes it. idleMs is how long the
+  // server is expected to keep it open; it is not reused after that.
+  void release(Transport* client, bool keep, uint32_t idleMs = 0) {
+    for (auto& s : _slots) {
+      if (&s.client != client) continue;
+      s.busy = false;
+      s.lastUse = millis();
+      s.idleMs = idleMs;
+      if (!keep || !client->connected()) clear(s);
+      return;
+    }
+  }
+
+  // Close least recently used idle connections while free heap is below
+  // minFreeHeap. acquire() does this before opening a connection.
+  void trim() {
+    while (ESP.getFreeHeap() < _opt.minFreeHeap) {
+      Slot* lru = nullptr;
+      for (auto& s : _slots) {
+        if (s.busy || s.host.length() == 0) continue;
+        if (!lru || s.lastUse < lru->lastUse) lru = &s;
+      }
+      if (!lru) return;
+      AHC_DEBUG("POOL: low heap, closing %s:%u", lru->host.c_str(), lru->port);
+      clear(*lru);
+      _evictions++;
+    }
+  }
+
+  // Requests served by an idle connection vs. ones that had to connect.
+  uint32_t hits() const { return _hits; }
+  uint32_t misses() const { return _misses; }
+  uint32_t evictions() const { return _evictions; }
+
+private:
+  struct Slot {
+    Transport client;
+    String host;  // empty = free
+    uint16_t port = 0;
+    bool busy = false;
+    uint32_t lastUse = 0;
+    uint32_t idleMs = 0;  // keep-alive window from lastUse
+  };
+
+  static void clear(Slot& s) {
+    s.client.stop();
+    s.host = "";
+    s.port = 0;
+  }
+
+  Slot _slots[ASYNC_HTTPSCLIENT_POOL_SIZE];
+  Options _opt;
+  uint32_t _hits = 0;
+  uint32_t _misses = 0;
+  uint32_t _evictions = 0;
+};
+
+// Transport: see above; AsyncHttpsClient is BasicAsyncHttpsClient<EspTransport>.
+template <class Transport>
+class BasicAsyncHttpsClient {
 public:
-  enum Method : uint8_t { M_GET, M_POST };
-  enum State  : uint8_t { IDLE, CONNECT, SEND, READ_HEADERS, READ_BODY, DONE, ERROR };
+  enum Method : uint8_t { M_GET, M_POST, M_HEAD };
+  static const int END_OF_BODY = -1;  // onRequestBodyChunk(): body complete
+  enum State  : uint8_t { IDLE, DNS_RESOLVE, CONNECT, SEND, READ_HEADERS, READ_BODY, DONE, ERROR };
+
+  // Non-owning view into the header arena. Valid until the next request starts.
+  // data is NUL-terminated, so c_str() can be printed or parsed directly.
+  struct HeaderView {
+    const char* data = nullptr;
+    size_t      len  = 0;
+    explicit operator bool() const { return data != nullptr; }
+    const char* c_str() const { return data ? data : ""; }
+  };
 
   struct Options {
-    uint32_t timeoutMs           = 15000;  // overall request timeout
-    uint16_t tlsHandshakeTimeout = 12000;  // handshake/socket timeout (coarse)
+    uint32_t timeoutMs           = 15000;  // overall request timeout (0 = none)
+    uint16_t dnsTimeoutMs        = 5000;   // asynchronous DNS lookup deadline
+    uint16_t connectTimeoutMs    = 12000;  // TCP connect (ESP8266 uses tlsHandshakeTimeout)
+    uint16_t tlsHandshakeTimeout = 12000;  // TLS handshake
+    uint16_t firstByteTimeoutMs  = 0;      // request sent -> first response byte (0 = none, opt in)
+    uint16_t idleTimeoutMs       = 0;      // longest stall while sending or receiving (0 = none, opt in)
     size_t   maxHeaderBytes      = 4096;   // protect RAM
     size_t   maxBodyBytes        = 16 * 1024; // default body buffer limit (can stream instead)
     size_t   ioChunkSize         = 512;    // read buffer size
+    size_t   sendChunkBytes      = 1024;   // request bytes written per poll() (0 = no limit)
     bool     keepBody            = true;   // set false to stream-only
+    bool     keepHeaders         = true;   // set false to skip the header arena (use onHeader)
     bool     keepAlive           = false;  // reuse TLS socket between requests when possible
+    uint32_t keepAliveIdleMs     = 0;      // idle window assumed without a Keep-Alive timeout (0 = none)
+    bool     tlsResume           = true;   // resume cached TLS sessions (not ESP32)
+    uint8_t  pipelineDepth       = 4;      // GETs written back-to-back with pipelineGet() (1 = off)
+    uint32_t dnsTtlSec           = 300;    // lifetime of a resolved IP kept in WarmState
+    uint32_t warmMaxAgeSec       = 24 * 3600; // WarmState older than this is ignored
+  };
+
+  // Everything a fresh boot needs to skip SNTP, DNS and a full TLS handshake
+  // for the last host. Plain bytes: keep it in RTC memory or a file across
+  // deep sleep. Sized in whole words for ESP.rtcUserMemoryWrite().
+  struct WarmState {
+    uint32_t magic;
+    uint32_t crc;            // over everything after this field
+    uint32_t epoch;          // unix time at export
+    uint32_t ip;             // IPv4, network byte order (0 = none)
+    uint32_t ipExpires;      // epoch after which ip must be looked up again
+    uint16_t port;
+    uint8_t  hasSession;
+    uint8_t  reserved;
+    char     host[64];
+    uint8_t  session[(sizeof(typename Transport::Session) + 3) & ~3u];
   };
 
-  AsyncHttpsClient() = default;
-  virtual ~AsyncHttpsClient() { stop(); }
+  // Kept for every request; read after done() or error().
+  using Timings = AhcTimings;
+
+  BasicAsyncHttpsClient() = default;
+  virtual ~BasicAsyncHttpsClient() { stop(); }
 
   // ---------- REQUIRED for TLS security ----------
   // Provide a CA certificate (PEM). This is used for verification.
@@ -52,10 +703,8 @@ public:
   void setCACert(const char* caPem) {
     _caPem = caPem;
     _hasCa = (caPem && caPem[0]);
-#if defined(ESP8266)
-    // Create/replace trust anchors. X509List copies/parses the PEM.
-    _ta.reset(new BearSSL::X509List(_caPem));
-#endif
+    // A resumed session skips verification, so drop ones set up under the old CA.
+    clearTlsSessions();
     AHC_DEBUG("setCACert: %s", _hasCa ? "loaded" : "empty");
   }
 
@@ -63,6 +712,7 @@ public:
   // Call after SNTP sync, or explicitly set epoch seconds.
   void setUnixTime(time_t nowEpoch) {
     _nowEpoch = nowEpoch;
+    _timeSetMs = millis();
     _hasTime = (nowEpoch > 1600000000);
     AHC_DEBUG("setUnixTime: %ld (valid=%d)", long(nowEpoch), _hasTime);
   }
@@ -73,17 +723,127 @@ public:
               (unsigned)_opt.maxBodyBytes, _opt.keepBody);
   }
 
+  // Borrow connections from a shared pool instead of the client's own socket;
+  // requests then ask for keep-alive and return the connection when done.
+  // Pass nullptr to go back. Call between requests.
+  void setPool(BasicAsyncHttpsPool<Transport>* pool) {
+    dropSocket();
+    _pool = pool;
+  }
+
+  // Add every finished request to stats (nullptr stops). The stats table
+  // must outlive the client.
+  void setStats(AsyncHttpsStats* stats) { _stats = stats; }
+
   // ---------- Requests ----------
   // path must include query if needed, e.g. "/v1/ping?x=1"
   bool beginGet(const String& host, uint16_t port, const String& path,
                 const String& extraHeaders = "") {
-    return beginRequest(M_GET, host, port, path, "", "", extraHeaders);
+    return beginRequest(M_GET, host, port, path, nullptr, 0, "", extraHeaders);
   }
 
+  // The body is copied once into the client.
   bool beginPost(const String& host, uint16_t port, const String& path,
                  const String& body, const String& contentType = "application/json",
                  const String& extraHeaders = "") {
-    return beginRequest(M_POST, host, port, path, body, contentType, extraHeaders);
+    return beginPost(host, port, path, String(body), contentType, extraHeaders);
+  }
+
+  // The body is moved into the client (no copy) and freed once it is sent.
+  bool beginPost(const String& host, uint16_t port, const String& path,
+                 String&& body, const String& contentType = "application/json",
+                 const String& extraHeaders = "") {
+    String owned(std::move(body));
+    if (!beginRequest(M_POST, host, port, path, nullptr, owned.length(), contentType, extraHeaders)) {
+      return false;
+    }
+    _reqBody = std::move(owned);
+    if (_txBodySeg < _txCount) _tx[_txBodySeg].data = _reqBody.c_str();
+    return true;
+  }
+
+  // The body is sent by reference: keep it valid until done()/error().
+  bool beginPost(const String& host, uint16_t port, const String& path,
+                 const uint8_t* body, size_t bodyLen,
+                 const String& contentType = "application/json",
+                 const String& extraHeaders = "") {
+    return beginRequest(M_POST, host, port, path, body, bodyLen, contentType, extraHeaders);
+  }
+
+  // Body is pulled from onRequestBodyChunk() while sending, so it never has
+  // to fit in RAM. contentLength < 0 sends it with chunked transfer encoding.
+  bool beginPostStream(const String& host, uint16_t port, const String& path,
+                       int32_t contentLength = -1,
+                       const String& contentType = "application/octet-stream",
+                       const String& extraHeaders = "") {
+    size_t len = contentLength < 0 ? SIZE_MAX : (size_t)contentLength;
+    return beginRequest(M_POST, host, port, path, nullptr, len, contentType, extraHeaders, true);
+  }
+
+  // Queue another GET on the same host, written right behind the current one
+  // on the kept-alive socket. Call after beginGet() and before the first
+  // poll(). When done() (or error()), read the result and call
+  // nextPipelined() to move on to the next response.
+  bool pipelineGet(const String& path) {
+    bool unsent = (_state == DNS_RESOLVE || _state == CONNECT || _state == SEND) && _txSent == 0;
+    if (!unsent || _method != M_GET || !keepAlive() ||
+        (_pipeSeg >= _txCount && _txCount >= kMaxTxSegments) ||
+        _pipeQueued + 1u >= _opt.pipelineDepth || path.indexOf('\n') >= 0) {
+      return false;
+    }
+    appendGetRequest(_pipeTx, path);
+    _pipePaths += path;
+    _pipePaths += '\n';
+    _pipeQueued++;
+    _pipeOnSocket = true;
+    if (_pipeSeg >= _txCount) {
+      _pipeSeg = _txCount;
+      addTx(_pipeTx.c_str(), _pipeTx.length());
+    }
+    _tx[_pipeSeg].data = _pipeTx.c_str();  // the String may have moved
+    _tx[_pipeSeg].len = _pipeTx.length();
+    return true;
+  }
+
+  // Responses still expected from pipelineGet() requests.
+  size_t pipelinePending() const { return _pipeQueued; }
+
+  // Start reading the next pipelined response (after done() or error()).
+  // If the server closed the connection, the remaining requests are sent
+  // again one at a time on a new one.
+  bool nextPipelined() {
+    if (_pipeQueued == 0 || (_state != DONE && _state != ERROR)) return false;
+    int nl = _pipePaths.indexOf('\n');
+    String path = _pipePaths.substring(0, nl);
+    _pipePaths.remove(0, nl + 1);
+    _pipeQueued--;
+
+    if (_pipeOnSocket && _state == DONE) {
+      resetResponse();
+      _socketReused = false;  // a retry would resend the answered requests
+      _tm = Timings();
+      _tm.reused = true;
+      _t0 = millis();
+      _stageT0 = _t0;
+      _ioT0 = _t0;
+      _awaitingFirstByte = true;
+      _state = READ_HEADERS;
+      AHC_DEBUG("PIPELINE: reading response for %s (%u left)", path.c_str(), (unsigned)_pipeQueued);
+      return true;
+    }
+
+    AHC_DEBUG("PIPELINE: connection lost, resending %s", path.c_str());
+    _pipeOnSocket = false;
+    _pipeResend = true;
+    bool ok = beginRequest(M_GET, _host, _port, path, nullptr, 0, "", _extraHeaders);
+    _pipeResend = false;
+    return ok;
+  }
+
+  // Headers only; the response completes as soon as the header block ends.
+  bool beginHead(const String& host, uint16_t port, const String& path,
+                 const String& extraHeaders = "") {
+    return beginRequest(M_HEAD, host, port, path, nullptr, 0, "", extraHeaders);
   }
 
   // Pump the request. Call often from loop().
@@ -96,13 +856,10 @@ public:
     delay(0);
 #endif
 
-    if (millis() - _t0 > _opt.timeoutMs) {
-      AHC_DEBUG("timeout after %lu ms (state=%d)", (unsigned long)(millis() - _t0), _state);
-      fail("timeout");
-      return;
-    }
+    if (!checkDeadlines()) return;
 
     switch (_state) {
+      case DNS_RESOLVE:   stepResolve(); break;
       case CONNECT:       stepConnect(); break;
       case SEND:          stepSend(); break;
       case READ_HEADERS:  stepReadHeaders(); break;
@@ -118,41 +875,209 @@ public:
 
   int status() const { return _httpStatus; }
   const String& errorMsg() const { return _err; }
+  // State the request was in when it failed (e.g. CONNECT, READ_BODY).
+  State errorStage() const { return _errStage; }
 
   // If keepBody==true and response <= maxBodyBytes, this returns it.
   const String& body() const { return _body; }
 
+  // Move the body out without copying; the next request starts a fresh buffer.
+  // Use after done()/error(), not while a body is being read.
+  String takeBody() {
+    String out(std::move(_body));
+    _bodyCap = 0;
+    return out;
+  }
+
+  // Hand a String (e.g. one from takeBody()) back so its allocation is reused
+  // for the next body. Contents are discarded. Call between requests.
+  void recycleBody(String&& buf) {
+    _body = std::move(buf);
+    _body = "";  // keeps the capacity
+    _bodyCap = 0;  // unknown; reserve() is a no-op while it still fits
+  }
+
+  // Capture the body into caller-owned memory instead of body() (pass nullptr
+  // to go back). No heap is used; a longer body is truncated, the request
+  // still completes and bodyOverflow() reports it. Call between requests.
+  void setBodyBuffer(uint8_t* buf, size_t cap) {
+    _userBody = buf;
+    _userBodyCap = buf ? cap : 0;
+    _userBodyLen = 0;
+  }
+
+  // Body bytes captured so far, from the caller buffer or body().
+  const uint8_t* bodyData() const { return _userBody ? _userBody : (const uint8_t*)_body.c_str(); }
+  size_t bodyLength() const { return _userBody ? _userBodyLen : _body.length(); }
+  bool bodyOverflow() const { return _bodyOverflow; }
+
+  // ---------- Connection timing ----------
+  // TCP + TLS handshake time of the last new connection (0 if the socket was
+  // reused) and whether it resumed a cached session instead of a full handshake.
+  uint32_t handshakeMs() const { return _handshakeMs; }
+  bool sessionResumed() const { return _sessionResumed; }
+
+  // Stage-by-stage breakdown of the last request.
+  const Timings& timings() const { return _tm; }
+
+  // Forget cached TLS sessions; the next connection per host is a full handshake.
+  void clearTlsSessions() {
+    for (auto& e : _tlsSessions) {
+      e.host = "";
+      e.port = 0;
+      e.valid = false;
+    }
+  }
+
+  // ---------- Warm state (deep sleep) ----------
+  // Snapshot the clock, the resolved IP and the TLS session of the last host
+  // before sleeping. Returns false if there is nothing worth keeping yet.
+  bool exportWarmState(WarmState& out) const {
+    memset(&out, 0, sizeof(out));
+    if (!_hasTime || _host.length() == 0 || _host.length() >= sizeof(out.host)) return false;
+    out.magic = kWarmMagic;
+    out.epoch = nowEpoch();
+    out.port = _port;
+    memcpy(out.host, _host.c_str(), _host.length() + 1);
+    if (_ipAddr && _ipHost == _host) {
+      out.ip = _ipAddr;
+      out.ipExpires = _ipExpires;
+    }
+    for (const auto& e : _tlsSessions) {
+      if (Transport::kResumesSessions && e.valid && e.port == _port && e.host == _host) {
+        memcpy(out.session, &e.session, sizeof(e.session));
+        out.hasSession = 1;
+      }
+    }
+    out.crc = warmCrc(out);
+    return true;
+  }
+
+  // Restore a snapshot at boot. sleptSeconds is the time spent asleep (from
+  // the RTC or the sleep duration) and advances the saved clock; a clock
+  // already set by setUnixTime()/SNTP is kept. Corrupt or stale state
+  // (older than warmMaxAgeSec) is rejected and the client starts cold; an
+  // expired IP is dropped and a rejected session falls back to a full
+  // handshake. Call setCACert() first: it drops cached sessions, so an
+  // import without a CA is refused rather than lost later.
+  bool importWarmState(const WarmState& in, uint32_t sleptSeconds) {
+    if (!_hasCa) {
+      AHC_DEBUG("warm state: setCACert() first, starting cold");
+      return false;
+    }
+    if (in.magic != kWarmMagic || in.crc != warmCrc(in) ||
+        memchr(in.host, 0, sizeof(in.host)) == nullptr) {
+      AHC_DEBUG("warm state: invalid, starting cold");
+      return false;
+    }
+    uint32_t age = _hasTime ? nowEpoch() - in.epoch : sleptSeconds;
+    if (age > _opt.warmMaxAgeSec) {
+      AHC_DEBUG("warm state: stale (%lu s), starting cold", (unsigned long)age);
+      return false;
+    }
+    if (!_hasTime) setUnixTime(time_t(in.epoch) + sleptSeconds);
+    uint32_t now = nowEpoch();
+
+    if (in.ip && now < in.ipExpires) {
+      _ipHost = in.host;
+      _ipAddr = in.ip;
+      _ipExpires = in.ipExpires;
+    }
+    if (in.hasSession) {
+      TlsSessionEntry* e = tlsSessionFor(String(in.host), in.port);
+      memcpy(&e->session, in.session, sizeof(e->session));
+      e->valid = true;
+    }
+    AHC_DEBUG("warm state: %s:%u ip=%d session=%d", in.host, in.port,
+              _ipAddr != 0, in.hasSession);
+    return true;
+  }
+
+  // ---------- Response headers ----------
+  // All headers of the last response live in one arena of maxHeaderBytes,
+  // allocated once and reused. Lookup is case-insensitive; first match wins.
+  // Empty when Options::keepHeaders is false.
+  HeaderView header(const char* name) const {
+    size_t n = strlen(name);
+    for (size_t i = 0; i < _hdrCount; i++) {
+      HeaderEntry e = headerEntry(i);
+      if (e.nameLen == n && equalsNoCase(_hdrArena + e.name, e.nameLen, name)) {
+        return view(e.value, e.valueLen);
+      }
+    }
+    return HeaderView();
+  }
+
+  size_t headerCount() const { return _hdrCount; }
+
+  bool headerAt(size_t i, HeaderView& name, HeaderView& value) const {
+    if (i >= _hdrCount) return false;
+    HeaderEntry e = headerEntry(i);
+    name = view(e.name, e.nameLen);
+    value = view(e.value, e.valueLen);
+    return true;
+  }
+
+  // Use a caller-owned arena instead of the heap (pass nullptr to go back).
+  // Call between requests; the buffer must outlive the client (max 64 KB used).
+  void setHeaderBuffer(char* buf, size_t cap) {
+    _hdrUser = buf;
+    _hdrUserCap = buf ? cap : 0;
+    _hdrArena = nullptr;
+    _hdrCap = 0;
+    _hdrUsed = 0;
+    _hdrCount = 0;
+  }
+
   // Stop/Reset
   void stop() {
-    _client.stop();
+    releaseDnsSlot();
+    dropSocket();
     _state = IDLE;
     AHC_DEBUG("stop -> IDLE");
   }
 
+  // Fail the request in progress with why, as if one of its own deadlines
+  // ran out: error() is set, errorStage() keeps the stage and the stats
+  // table counts it. For limits enforced outside the client.
+  void abortRequest(const char* why) {
+    if (_state == IDLE || _state == DONE || _state == ERROR) return;
+    fail(why);
+  }
+
   void reset(bool keepSocket = false) {
     AHC_DEBUG("reset() state=%d keepSocket=%d", _state, keepSocket);
     if (!keepSocket) {
       stop();
     } else {
-      while (_client.available()) _client.read();
+      uint8_t drain[64];
+      while (_client->available() > 0 && _client->read(drain, sizeof(drain)) > 0) {}
       _state = IDLE;
     }
-    _err = "";
-    _httpStatus = -1;
-    _body = "";
-    _bodyOverflow = false;
-    _req = "";
-    _headerBytes = 0;
-    _contentLength = -1;
-    _chunked = false;
-    _seenHeaderEnd = false;
-    _line = "";
-    _chunkState = CHUNK_SIZE;
-    _chunkRemaining = 0;
-    _chunkLine = "";
+    releaseDnsSlot();
+    _resolvedIp = 0;
+    _resolvedCached = false;
+    _rxHead = 0;
+    _rxTail = 0;
+    _txCount = 0;
+    _txIndex = 0;
+    _txOffset = 0;
+    _txSent = 0;
+    _txBodySeg = 0xFF;
+    _streamBody = false;
+    _streamChunked = false;
+    _streamEnded = false;
+    _streamPos = 0;
+    _streamLen = 0;
+    _streamRemaining = 0;
+    _pipeSeg = 0xFF;
+    _pipeTx = "";
+    releaseRequestBody();
     _stageT0 = 0;
-    _serverRequestedClose = false;
-    _bodyBytesRead = 0;
+    _tm = Timings();
+    _handshakeMs = 0;
+    _sessionResumed = false;
+    resetResponse();
   }
 
 protected:
@@ -161,27 +1086,86 @@ protected:
   virtual bool onBodyChunk(const uint8_t* data, size_t len) {
     if (!_opt.keepBody) return true;
 
+    if (_userBody) {
+      size_t n = min(len, _userBodyCap - _userBodyLen);
+      memcpy(_userBody + _userBodyLen, data, n);
+      _userBodyLen += n;
+      // Truncate but keep reading so the response (and socket) completes.
+      if (n < len) _bodyOverflow = true;
+      return true;
+    }
+
     // Enforce maxBodyBytes
-    if (_body.length() + len > _opt.maxBodyBytes) {
+    size_t need = _body.length() + len;
+    if (need > _opt.maxBodyBytes) {
       // keep what we have, but signal overflow
       _bodyOverflow = true;
       return false; // abort to protect RAM (prod-friendly behavior)
     }
 
-    // Append efficiently
-    _body.reserve(_body.length() + len);
-    for (size_t i = 0; i < len; i++) _body += char(data[i]);
+    // Grow geometrically (exact size was reserved if Content-Length is known)
+    if (need > _bodyCap) {
+      size_t cap = max(need, max<size_t>(_bodyCap * 2, 64));
+      if (!reserveBody(min(cap, _opt.maxBodyBytes)) && !reserveBody(need)) return false;
+    }
+
+    // Append as one block copy. The ESP8266 core's concat(ptr, len) copies
+    // len + 1 bytes, so the buffers that feed this (_rx and the bufLocal
+    // read buffers) keep one spare byte past their data.
+    return _body.concat((const char*)data, len);
+  }
+
+  // Supplies the body for beginPostStream(). Write up to cap bytes into buf and
+  // return the count; return 0 if nothing is ready yet (asked again on the next
+  // poll), END_OF_BODY when finished, or any other negative value to abort.
+  virtual int onRequestBodyChunk(uint8_t* buf, size_t cap) {
+    (void)buf; (void)cap;
+    return END_OF_BODY;
+  }
+
+  // Called for every response header as it is parsed. name/value point into
+  // the receive buffer and are NOT NUL-terminated. Return false to abort.
+  virtual bool onHeader(const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    (void)name; (void)nameLen; (void)value; (void)valueLen;
+    return true;
+  }
+
+  // Called once the blank line ending the headers arrives. Return false to abort.
+  virtual bool onHeadersComplete(int status) {
+    (void)status;
     return true;
   }
 
 private:
   // ---------- Internal ----------
+  // body must stay valid until SEND completes; a null body with a length
+  // reserves the segment for a String the caller attaches afterwards.
+  // With streamBody the body comes from onRequestBodyChunk() and bodyLen is
+  // the declared length (SIZE_MAX = unknown, sent chunked).
   bool beginRequest(Method m,
                     const String& host, uint16_t port, const String& path,
-                    const String& body, const String& contentType,
-                    const String& extraHeaders) {
-    bool reuseSocket = _opt.keepAlive && _client.connected() && !_serverRequestedClose;
+                    const uint8_t* body, size_t bodyLen, const String& contentType,
+                    const String& extraHeaders, bool streamBody = false) {
+    // Unread pipelined responses make the socket unusable for a new request.
+    bool unread = _pipeQueued > 0 && _pipeOnSocket;
+    // The socket is bound to the last request's host:port (_host/_port are
+    // still that request's here).
+    bool reuseSocket = !unread && keepAlive() && _client->connected() && !_serverRequestedClose &&
+                       port == _port && host == _host;
+    if (reuseSocket && millis() - _connLastUse >= _connIdleMs) {
+      AHC_DEBUG("KEEP-ALIVE: idle %lu ms past the server's window, reconnecting",
+                (unsigned long)(millis() - _connLastUse));
+      reuseSocket = false;
+    }
     reset(reuseSocket);
+    _socketReused = reuseSocket;
+    _tm.reused = reuseSocket;
+    _retried = false;
+    if (!_pipeResend) {
+      _pipePaths = "";
+      _pipeQueued = 0;
+    }
+    _pipeOnSocket = false;
 
     // Enforce TLS-secure prerequisites
     if (!_hasCa) {
@@ -195,168 +1179,460 @@ private:
       return false;
     }
 
-    _method = m;
-    _host = host;
+    if (!prepareHeaderArena()) {
+      fail("out of memory for headers");
+      return false;
+    }
+
+    if (streamBody && !_streamBuf) {
+      _streamBuf.reset(new (std::nothrow) uint8_t[ASYNC_HTTPSCLIENT_TX_BUFFER]);
+      if (!_streamBuf) {
+        fail("out of memory for request body");
+        return false;
+      }
+    }
+
+    _method = m;
+    _host = host;
     _port = port;
     _path = path;
-    AHC_DEBUG("begin %s https://%s:%u%s", m == M_GET ? "GET" : "POST",
+    AHC_DEBUG("begin %s https://%s:%u%s", methodName(m),
               host.c_str(), port, path.c_str());
 
-    // Configure TLS verification
-#if defined(ESP8266)
-    _client.setBufferSizes(512, 512); // reasonable defaults
-    _client.setTimeout(_opt.tlsHandshakeTimeout / 1000);
-    _client.setX509Time(_nowEpoch); // critical for cert validity checks
-    _client.setTrustAnchors(_ta.get());
-#elif defined(ESP32)
-    _client.setTimeout(_opt.tlsHandshakeTimeout / 1000);
-    _client.setCACert(_caPem);
-#endif
-
-    // Build HTTP/1.1 request
-    // (Connection: close simplifies correctness; you can add keep-alive later)
-    _req.reserve(256 + body.length() + extraHeaders.length());
-    _req += (m == M_GET ? F("GET ") : F("POST "));
-    _req += path;
-  _req += F(" HTTP/1.1\r\nHost: ");
-  _req += host;
-  _req += F("\r\nUser-Agent: esp-secure/1.0\r\nAccept: */*\r\nConnection: ");
-  _req += (_opt.keepAlive ? F("keep-alive") : F("close"));
-  _req += F("\r\n");
-
-    if (extraHeaders.length() > 0) {
+    // Describe the HTTP/1.1 request as segments; stepSend() streams them to
+    // the socket, so the payload is never concatenated into a second copy.
+    _extraHeaders = extraHeaders;
+    addTx(methodName(m), strlen(methodName(m)));
+    addTxP(PSTR(" "));
+    addTx(_path.c_str(), _path.length());
+    addTxP(PSTR(" HTTP/1.1\r\nHost: "));
+    addTx(_host.c_str(), _host.length());
+    addTxP(PSTR("\r\nUser-Agent: esp-secure/1.0\r\nAccept: */*\r\nConnection: "));
+    addTxP(keepAlive() ? PSTR("keep-alive\r\n") : PSTR("close\r\n"));
+
+    if (_extraHeaders.length() > 0) {
       // Caller must include proper CRLF lines, e.g. "Authorization: Bearer ...\r\n"
-      _req += extraHeaders;
+      addTx(_extraHeaders.c_str(), _extraHeaders.length());
       // Ensure it ends with CRLF (we'll be forgiving)
-      if (!extraHeaders.endsWith("\r\n")) _req += F("\r\n");
+      if (!_extraHeaders.endsWith("\r\n")) addTxP(PSTR("\r\n"));
     }
 
     if (m == M_POST) {
-      _req += F("Content-Type: ");
-      _req += contentType;
-      _req += F("\r\nContent-Length: ");
-      _req += String(body.length());
-      _req += F("\r\n\r\n");
-      _req += body;
+      _contentType = contentType;
+      addTxP(PSTR("Content-Type: "));
+      addTx(_contentType.c_str(), _contentType.length());
+      if (streamBody && bodyLen == SIZE_MAX) {
+        addTxP(PSTR("\r\nTransfer-Encoding: chunked\r\n\r\n"));
+      } else {
+        snprintf(_txLenDigits, sizeof(_txLenDigits), "%lu", (unsigned long)bodyLen);
+        addTxP(PSTR("\r\nContent-Length: "));
+        addTx(_txLenDigits, strlen(_txLenDigits));
+        addTxP(PSTR("\r\n\r\n"));
+      }
+      if (streamBody) {
+        _streamBody = true;
+        _streamRemaining = bodyLen;
+        _streamChunked = (bodyLen == SIZE_MAX);
+      } else {
+        _txBodySeg = _txCount;
+        addTx((const char*)body, bodyLen);
+      }
     } else {
-      _req += F("\r\n");
+      addTxP(PSTR("\r\n"));
     }
 
     _t0 = millis();
     _stageT0 = _t0;
-    _state = reuseSocket ? SEND : CONNECT;
+    _ioT0 = _t0;
+    _state = reuseSocket ? SEND : DNS_RESOLVE;
     if (reuseSocket) {
-      AHC_DEBUG("request ready (%u bytes), reusing TLS session", (unsigned)_req.length());
+      AHC_DEBUG("request ready (%u bytes), reusing TLS session", (unsigned)txTotal());
     } else {
-      AHC_DEBUG("request ready (%u bytes), entering CONNECT", (unsigned)_req.length());
+      AHC_DEBUG("request ready (%u bytes), entering DNS_RESOLVE", (unsigned)txTotal());
     }
     return true;
   }
 
-  void stepConnect() {
-    if (_client.connected()) {
-      _state = SEND;
-      AHC_DEBUG("CONNECT: already connected, moving to SEND");
-      logStageDuration("CONNECT");
+  // Resolve without blocking: lwIP answers through a callback into a static
+  // slot that we poll. The result also lands in lwIP's DNS cache, so the
+  // name-based connect() below (which keeps SNI and hostname verification)
+  // no longer waits on DNS.
+  void stepResolve() {
+    if (_dnsSlot < 0) {
+      // An idle pooled connection to this host skips DNS and the handshake.
+      if (_pool && _client == &_ownClient && acquirePooled() && _state == SEND) return;
+
+      IPAddress literal;
+      if (literal.fromString(_host)) {
+        _resolvedIp = uint32_t(literal);
+        _state = CONNECT;
+        return;
+      }
+      // Imported or earlier result still within its TTL: skip the lookup.
+      if (Transport::kConnectByIp && _ipAddr && _ipHost == _host && nowEpoch() < _ipExpires) {
+        AHC_DEBUG("DNS: %s from warm state", _host.c_str());
+        _resolvedIp = _ipAddr;
+        _resolvedCached = true;
+        _state = CONNECT;
+        return;
+      }
+      _dnsSlot = startDnsLookup(_host.c_str());
+      if (_dnsSlot < 0) {
+        // No free slot or name too long: connect() resolves it itself.
+        AHC_DEBUG("DNS: async lookup unavailable, resolving in CONNECT");
+        _state = CONNECT;
+        return;
+      }
+      _dnsT0 = millis();
+    }
+
+    DnsSlot& slot = dnsSlots()[_dnsSlot];
+    if (slot.state == DNS_PENDING) {
+      if (millis() - _dnsT0 > _opt.dnsTimeoutMs) fail("DNS timeout");
+      return;
+    }
+
+    bool ok = (slot.state == DNS_DONE);
+    _resolvedIp = slot.ip;
+    releaseDnsSlot();
+    if (!ok) {
+      AHC_DEBUG("DNS: lookup failed for %s", _host.c_str());
+      fail("DNS lookup failed");
       return;
     }
+    AHC_DEBUG("DNS: %s resolved", _host.c_str());
+    _ipHost = _host;
+    _ipAddr = _resolvedIp;
+    _ipExpires = nowEpoch() + _opt.dnsTtlSec;
+    markStage(DNS_RESOLVE);
+    _state = CONNECT;
+  }
+
+  void stepConnect() {
+    if (_pool && _client == &_ownClient) {
+      if (!acquirePooled()) return;  // host or pool at its limit: retry next poll
+      if (_state != CONNECT) return;
+    }
+
+    if (!_connecting) {
+      if (_client->connected()) {
+        _ioT0 = millis();
+        _state = SEND;
+        AHC_DEBUG("CONNECT: already connected, moving to SEND");
+        markStage(CONNECT);
+        return;
+      }
+      _connecting = true;
+      _hsT0 = millis();
+      _connSession = (_opt.tlsResume && Transport::kResumesSessions)
+                         ? tlsSessionFor(_host, _port) : nullptr;
+    }
 
-    // DNS + TCP + TLS handshake is inside connect() for secure client.
-    if (!_client.connect(_host.c_str(), _port)) {
+    // TCP + TLS handshake; a non-blocking transport asks to be called again.
+    AhcTlsParams tp;
+    tp.host = _host.c_str();
+    tp.port = _port;
+    tp.ip = Transport::kConnectByIp ? _resolvedIp : 0;
+    tp.caPem = _caPem;
+    tp.now = nowEpoch();
+    tp.connectTimeoutMs = connectTimeout();
+    tp.handshakeTimeoutMs = _opt.tlsHandshakeTimeout;
+    AhcConnect r = _client->connect(tp, _connSession ? &_connSession->session : nullptr);
+    if (r == AhcConnect::PENDING) return;
+    _connecting = false;
+
+    TlsSessionEntry* cached = _connSession;
+    _connSession = nullptr;
+    uint32_t took = millis() - _hsT0;
+    _tm.tcpMs = min<uint32_t>(_client->tcpConnectMs(), took);
+    _tm.tlsMs = ms16(took - _tm.tcpMs);
+    if (r != AhcConnect::DONE) {
       AHC_DEBUG("CONNECT: failed to %s:%u", _host.c_str(), _port);
-      fail(String("connect/TLS failed") + tlsErrorDetail());
+      if (cached) cached->valid = false;
+      if (_resolvedCached) {
+        // The remembered address may have moved: look it up again once.
+        AHC_DEBUG("CONNECT: dropping cached IP, resolving again");
+        _client->stop();
+        _ipAddr = 0;
+        _resolvedIp = 0;
+        _resolvedCached = false;
+        _state = DNS_RESOLVE;
+        return;
+      }
+      // The transport enforces its budgets and says which one ran out.
+      if (r == AhcConnect::TLS_TIMEOUT) {
+        fail(String("TLS handshake timeout") + tlsErrorDetail());
+      } else if (r == AhcConnect::TCP_TIMEOUT) {
+        fail("connect timeout");
+      } else {
+        fail(String("connect/TLS failed") + tlsErrorDetail());
+      }
       return;
     }
+    _handshakeMs = took;
+    _tm.newConnection = true;
 
-    AHC_DEBUG("CONNECT: success to %s:%u", _host.c_str(), _port);
-    logStageDuration("CONNECT");
+    if (cached) {
+      _sessionResumed = cached->valid && _client->sessionResumed();
+      cached->valid = true;
+    }
+    AHC_DEBUG("CONNECT: success to %s:%u (%s handshake, %lu ms)", _host.c_str(), _port,
+              _sessionResumed ? "resumed" : "full", (unsigned long)_handshakeMs);
+    markStage(CONNECT);
+    _ioT0 = millis();
     _state = SEND;
   }
 
   void stepSend() {
-    if (!_client.connected()) {
-      fail("socket closed before send");
+    if (!_client->connected()) {
+      if (!retryOnFreshSocket("closed before send")) fail("socket closed before send");
       return;
     }
 
-    size_t w = _client.print(_req);
-    if (w == 0) {
-      fail("send failed");
-      return;
+    // Write what the socket takes, at most sendChunkBytes per poll(); the
+    // cursor resumes from there on the next call. Small segments are gathered
+    // into one write (one TLS record); a large RAM segment such as the body
+    // goes to the client without a copy.
+    uint8_t stage[256];
+    size_t budget = _opt.sendChunkBytes ? _opt.sendChunkBytes : SIZE_MAX;
+    int room = _client->availableForWrite();
+    if (room == 0) return;  // send buffer full: a write would block, retry next poll
+    if (room > 0) budget = min(budget, (size_t)room);
+    while (_txIndex < _txCount && budget > 0) {
+      const TxSegment& seg = _tx[_txIndex];
+      size_t want;
+      size_t w;
+      if (!seg.progmem && seg.len - _txOffset >= sizeof(stage)) {
+        want = min(seg.len - _txOffset, budget);
+        w = _client->write((const uint8_t*)seg.data + _txOffset, want);
+      } else {
+        want = gatherTx(stage, min(sizeof(stage), budget));
+        w = _client->write(stage, want);
+      }
+      if (w == 0) {
+        if (!_client->connected() && !retryOnFreshSocket("send failed")) fail("send failed");
+        return;
+      }
+      advanceTx(w);
+      _txSent += w;
+      _tm.bytesOut += w;
+      _ioT0 = millis();
+      budget -= w;
+      if (w < want) return;  // socket is full, retry next poll
     }
-    AHC_DEBUG("SEND: wrote %u bytes", (unsigned)w);
-    logStageDuration("SEND");
+    if (_txIndex < _txCount) return;
+    if (_streamBody && !pumpStreamBody(budget)) return;
+
+    AHC_DEBUG("SEND: wrote %u bytes", (unsigned)_txSent);
+    markStage(SEND);
+    releaseRequestBody();
+    _ioT0 = millis();
+    _awaitingFirstByte = true;
     _state = READ_HEADERS;
   }
 
-  void stepReadHeaders() {
-    if (!_client.connected() && !_client.available()) {
-      fail("closed during headers");
-      return;
+  // Pull the body from onRequestBodyChunk() into _streamBuf and write it out,
+  // framed as chunks when the length is unknown. Returns true once complete.
+  bool pumpStreamBody(size_t budget) {
+    while (budget > 0) {
+      if (_streamPos == _streamLen) {
+        if (_streamEnded) return true;
+        if (!pullStreamBody()) return false;
+        continue;
+      }
+      size_t want = min(_streamLen - _streamPos, budget);
+      size_t w = _client->write(_streamBuf.get() + _streamPos, want);
+      if (w == 0) {
+        if (!_client->connected()) fail("send failed");
+        return false;
+      }
+      _streamPos += w;
+      _txSent += w;
+      _tm.bytesOut += w;
+      _ioT0 = millis();
+      budget -= w;
+      if (w < want) return false;  // socket is full, retry next poll
     }
+    return _streamPos == _streamLen && _streamEnded;
+  }
 
-    // Read header bytes and parse lines until \r\n\r\n
-    while (_client.available()) {
-      int c = _client.read();
-      if (c < 0) break;
-
-      _headerBytes++;
-      if (_headerBytes > _opt.maxHeaderBytes) {
-        fail("headers too large");
-        return;
+  bool pullStreamBody() {
+    uint8_t* data = _streamBuf.get() + (_streamChunked ? kFrameHead : 0);
+    size_t cap = ASYNC_HTTPSCLIENT_TX_BUFFER - (_streamChunked ? kFrameHead + 2 : 0);
+    if (!_streamChunked) {
+      if (_streamRemaining == 0) {
+        _streamEnded = true;
+        _streamPos = _streamLen = 0;
+        return true;
       }
+      cap = min(cap, _streamRemaining);
+    }
 
-      char ch = char(c);
-      _line += ch;
-
-      // line buffer protection
-      if (_line.length() > 512) {
-        fail("header line too long");
-        return;
+    int n = onRequestBodyChunk(data, cap);
+    if (n == 0) return false;  // nothing ready yet
+    if (n == END_OF_BODY) {
+      if (!_streamChunked) {
+        fail("request body shorter than Content-Length");
+        return false;
       }
+      memcpy_P(_streamBuf.get(), PSTR("0\r\n\r\n"), 5);
+      _streamPos = 0;
+      _streamLen = 5;
+      _streamEnded = true;
+      return true;
+    }
+    if (n < 0 || (size_t)n > cap) {
+      fail("request body provider aborted");
+      return false;
+    }
 
-      // Detect end of line
-      if (ch == '\n') {
-        String line = _line;
-        _line = "";
-
-        line.trim(); // removes \r\n and whitespace
+    if (!_streamChunked) {
+      _streamPos = 0;
+      _streamLen = (size_t)n;
+      _streamRemaining -= (size_t)n;
+      return true;
+    }
+    // Frame in place: hex size + CRLF right before the data, CRLF after it.
+    char head[kFrameHead + 1];
+    int h = snprintf(head, sizeof(head), "%X\r\n", (unsigned)n);
+    _streamPos = kFrameHead - (size_t)h;
+    memcpy(_streamBuf.get() + _streamPos, head, (size_t)h);
+    data[n] = '\r';
+    data[n + 1] = '\n';
+    _streamLen = kFrameHead + (size_t)n + 2;
+    return true;
+  }
 
-        if (line.length() == 0) {
-          _seenHeaderEnd = true;
-          AHC_DEBUG("HEADERS: done (status=%d chunked=%d len=%ld)", _httpStatus, _chunked, (long)_contentLength);
-          logStageDuration("HEADERS");
-          _state = READ_BODY;
+  void stepReadHeaders() {
+    // Parse complete lines in place from the scratch buffer; refill in bulk.
+    size_t scanned = 0;  // bytes of the current line already searched for '\n'
+    for (;;) {
+      const char* start = (const char*)_rx + _rxHead;
+      size_t buffered = _rxTail - _rxHead;
+      const char* nl = buffered > scanned ? (const char*)memchr(start + scanned, '\n', buffered - scanned) : nullptr;
+
+      if (!nl) {
+        if (_headerBytes + buffered > _opt.maxHeaderBytes) {
+          fail("headers too large");
           return;
         }
-
-        // Status line
-        if (line.startsWith("HTTP/1.1") && line.length() >= 12) {
-          _httpStatus = line.substring(9, 12).toInt();
-          AHC_DEBUG("HEADERS: status line %d", _httpStatus);
-          continue;
+        // line buffer protection
+        if (buffered >= ASYNC_HTTPSCLIENT_RX_BUFFER) {
+          fail("header line too long");
+          return;
         }
+        scanned = buffered;
+        if (fillRx() == 0) break;
+        continue;
+      }
 
-        // Headers we care about
-        // Content-Length
-        if (startsWithNoCase(line, "Content-Length:")) {
-          String v = line.substring(strlen("Content-Length:"));
-          v.trim();
-          _contentLength = v.toInt();
+      size_t consumed = size_t(nl - start) + 1;
+      _headerBytes += consumed;
+      if (_headerBytes > _opt.maxHeaderBytes) {
+        fail("headers too large");
+        return;
+      }
+      _rxHead += consumed;
+      scanned = 0;
+
+      // Trim CRLF and surrounding whitespace without copying
+      size_t len = consumed - 1;
+      while (len > 0 && isSpace(start[len - 1])) len--;
+      while (len > 0 && isSpace(*start)) { start++; len--; }
+
+      if (len == 0) {
+        if (isInterimStatus()) {
+          // 100 Continue / 103 Early Hints: drop them, the real response follows.
+          AHC_DEBUG("HEADERS: skipped interim %d", _httpStatus);
+          _httpStatus = -1;
+          _headerBytes = 0;
+          _hdrUsed = 0;
+          _hdrCount = 0;
+          _contentLength = -1;
+          _chunked = false;
           continue;
         }
-
-        // Transfer-Encoding: chunked
-        if (startsWithNoCase(line, "Transfer-Encoding:")) {
-          if (containsNoCase(line, "chunked")) _chunked = true;
-          continue;
+        _seenHeaderEnd = true;
+        AHC_DEBUG("HEADERS: done (status=%d chunked=%d len=%ld)", _httpStatus, _chunked, (long)_contentLength);
+        markStage(READ_HEADERS);
+        if (!onHeadersComplete(_httpStatus)) {
+          fail("header handler aborted");
+          return;
+        }
+        if (!responseHasBody()) {
+          AHC_DEBUG("HEADERS: no body expected");
+          finalizeResponse();
+          return;
+        }
+        // Size the body store once when the length is known and fits the cap.
+        if (_opt.keepBody && !_userBody && !_chunked && _contentLength > 0 && (size_t)_contentLength <= _opt.maxBodyBytes) {
+          reserveBody((size_t)_contentLength);
         }
+        _state = READ_BODY;
+        return;
+      }
 
-        if (startsWithNoCase(line, "Connection:")) {
-          if (containsNoCase(line, "close")) _serverRequestedClose = true;
-          continue;
+      // Status line
+      if (len >= 12 && memcmp(start, "HTTP/1.", 7) == 0) {
+        int code = 0;
+        for (size_t i = 9; i < 12; i++) {
+          if (start[i] < '0' || start[i] > '9') { code = -1; break; }
+          code = code * 10 + (start[i] - '0');
         }
+        if (code >= 0) {
+          _httpStatus = code;
+          AHC_DEBUG("HEADERS: status line %d", _httpStatus);
+        }
+        continue;
+      }
+
+      // Interim (1xx) header fields are not part of the response.
+      if (isInterimStatus()) continue;
+
+      const char* colon = (const char*)memchr(start, ':', len);
+      if (!colon) continue;
+      size_t nameLen = size_t(colon - start);
+      while (nameLen > 0 && isSpace(start[nameLen - 1])) nameLen--;
+      const char* value = colon + 1;
+      size_t valueLen = len - size_t(value - start);
+      while (valueLen > 0 && isSpace(*value)) { value++; valueLen--; }
+
+      if (_opt.keepHeaders && !storeHeader(start, nameLen, value, valueLen)) {
+        fail("headers too large");
+        return;
       }
+      if (!onHeader(start, nameLen, value, valueLen)) {
+        fail("header handler aborted");
+        return;
+      }
+
+      // Headers we care about
+      if (equalsNoCase(start, nameLen, "Content-Length")) {
+        _contentLength = parseContentLength(value, valueLen);
+        continue;
+      }
+
+      // Transfer-Encoding: chunked
+      if (equalsNoCase(start, nameLen, "Transfer-Encoding")) {
+        if (containsNoCase(value, valueLen, "chunked")) _chunked = true;
+        continue;
+      }
+
+      if (equalsNoCase(start, nameLen, "Connection")) {
+        if (containsNoCase(value, valueLen, "close")) _serverRequestedClose = true;
+        continue;
+      }
+
+      // Keep-Alive: timeout=5, max=100
+      if (equalsNoCase(start, nameLen, "Keep-Alive")) {
+        _kaTimeoutS = keepAliveParam(value, valueLen, "timeout");
+        _kaMax = keepAliveParam(value, valueLen, "max");
+        continue;
+      }
+    }
+
+    if (!_client->connected() && !_client->available()) {
+      if (!retryOnFreshSocket("closed during headers")) fail("closed during headers");
     }
   }
 
@@ -369,20 +1645,21 @@ private:
     }
 
     // Non-chunked body (Content-Length or until close)
-    uint8_t bufLocal[768];
-    const size_t bufSz = min<size_t>(_opt.ioChunkSize, sizeof(bufLocal));
-
-    while (_client.available()) {
-  size_t toRead = min(bufSz, (size_t)_client.available());
-#if defined(ESP8266)
-  int n = _client.readBytes((char*)bufLocal, toRead);
-#else
-  int n = _client.read(bufLocal, toRead);
-#endif
+    uint8_t bufLocal[768 + 1];  // +1: see onBodyChunk()
+    const size_t bufSz = min<size_t>(_opt.ioChunkSize, sizeof(bufLocal) - 1);
+
+    while (bufferedAvailable()) {
+      size_t toRead = min(bufSz, bufferedAvailable());
+      if (_contentLength >= 0) {
+        // Never read past the message: the rest belongs to the next response.
+        toRead = min(toRead, (size_t)_contentLength - _bodyBytesRead);
+        if (toRead == 0) break;
+      }
+      int n = readBuffered(bufLocal, toRead);
       if (n <= 0) break;
 
       if (!onBodyChunk(bufLocal, (size_t)n)) {
-        fail(_bodyOverflow ? "body exceeded maxBodyBytes" : "body handler aborted");
+        failBodyAborted();
         return;
       }
       _bodyBytesRead += (size_t)n;
@@ -395,130 +1672,554 @@ private:
       return;
     }
 
-    if (!_client.connected() && !_client.available()) {
+    if (!_client->connected() && !bufferedAvailable()) {
+      if (_contentLength >= 0) {
+        fail("closed during body");
+        return;
+      }
       AHC_DEBUG("BODY: complete (status=%d)", _httpStatus);
       finalizeResponse();
     }
   }
 
-  // -------- Chunked decoding (minimal, robust enough for typical APIs) --------
-  enum ChunkState : uint8_t { CHUNK_SIZE, CHUNK_DATA, CHUNK_CRLF, CHUNK_DONE };
+  // -------- Warm state --------
+  static const uint32_t kWarmMagic = 0x41484331;  // "AHC1"
 
-  void stepReadChunkedBody() {
-    uint8_t bufLocal[768];
-    const size_t bufSz = min<size_t>(_opt.ioChunkSize, sizeof(bufLocal));
-
-    while (_client.available()) {
-      int c = _client.read();
-      if (c < 0) break;
-      char ch = char(c);
-
-      switch (_chunkState) {
-        case CHUNK_SIZE: {
-          // Read hex size line until \n
-          if (ch == '\n') {
-            _chunkLine.trim(); // remove \r and spaces
-            // ignore chunk extensions: "A;ext=1"
-            int semi = _chunkLine.indexOf(';');
-            String sizeStr = (semi >= 0) ? _chunkLine.substring(0, semi) : _chunkLine;
-            sizeStr.trim();
-
-            _chunkRemaining = (size_t) strtoul(sizeStr.c_str(), nullptr, 16);
-            _chunkLine = "";
-
-            if (_chunkRemaining == 0) {
-              _chunkState = CHUNK_DONE;
-              AHC_DEBUG("CHUNK: terminal chunk reached");
-              // consume trailing headers (optional) until close or empty line
-              // We'll just finish once socket closes or no data; many servers close after 0-chunk.
-            } else {
-              AHC_DEBUG("CHUNK: size=%u", (unsigned)_chunkRemaining);
-              _chunkState = CHUNK_DATA;
-            }
-          } else {
-            _chunkLine += ch;
-            if (_chunkLine.length() > 64) { fail("chunk size line too long"); return; }
-          }
-        } break;
-
-        case CHUNK_DATA: {
-          // We already consumed one byte (ch) of data; handle it plus bulk reads
-          uint8_t one = (uint8_t)ch;
-          if (!onBodyChunk(&one, 1)) { fail(_bodyOverflow ? "body exceeded maxBodyBytes" : "body handler aborted"); return; }
-          _chunkRemaining--;
-          AHC_DEBUG("CHUNK: wrote 1 byte (remain=%u)", (unsigned)_chunkRemaining);
-
-          // Bulk read more if available
-          while (_chunkRemaining > 0 && _client.available()) {
-            size_t want = min(_chunkRemaining, bufSz);
-            want = min(want, (size_t)_client.available());
-#if defined(ESP8266)
-            int n = _client.readBytes((char*)bufLocal, want);
+  uint32_t nowEpoch() const {
+    return uint32_t(_nowEpoch) + (millis() - _timeSetMs) / 1000;
+  }
+
+  static uint32_t warmCrc(const WarmState& w) {
+    const uint8_t* p = (const uint8_t*)&w + offsetof(WarmState, epoch);
+    size_t n = sizeof(WarmState) - offsetof(WarmState, epoch);
+    uint32_t crc = 0xFFFFFFFF;
+    while (n--) {
+      crc ^= *p++;
+      for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+  }
+
+  // -------- TLS session cache --------
+  struct TlsSessionEntry {
+    String host;
+    uint16_t port = 0;
+    bool valid = false;  // session holds parameters from a completed handshake
+    uint32_t lastUse = 0;
+    typename Transport::Session session;
+  };
+
+  // Entry for host:port, evicting the least recently used one if needed.
+  TlsSessionEntry* tlsSessionFor(const String& host, uint16_t port) {
+    TlsSessionEntry* victim = &_tlsSessions[0];
+    for (auto& e : _tlsSessions) {
+      if (e.port == port && e.host == host) {
+        e.lastUse = millis();
+        return &e;
+      }
+      if (e.lastUse < victim->lastUse) victim = &e;
+    }
+    victim->host = host;
+    victim->port = port;
+    victim->valid = false;
+    victim->lastUse = millis();
+    victim->session = typename Transport::Session();
+    return victim;
+  }
+
+  // -------- Asynchronous DNS --------
+  enum DnsState : uint8_t { DNS_FREE, DNS_PENDING, DNS_DONE, DNS_FAILED };
+
+  // Slots live in static storage so a late lwIP callback never touches a
+  // client that was reset or destroyed; such a slot is marked abandoned.
+  // On ESP32 the callback runs on the tcpip task and can finish just after
+  // releaseDnsSlot() saw DNS_PENDING, leaving an abandoned DNS_DONE or
+  // DNS_FAILED slot; startDnsLookup() takes those back.
+  struct DnsSlot {
+    volatile uint8_t state;
+    volatile bool abandoned;
+    uint32_t ip;
+    char host[96];
+  };
+
+  static DnsSlot* dnsSlots() {
+    static DnsSlot slots[ASYNC_HTTPSCLIENT_DNS_SLOTS];
+    return slots;
+  }
+
+#if ASYNC_HTTPSCLIENT_LWIP_DNS
+  static int8_t startDnsLookup(const char* host) {
+    size_t n = strlen(host);
+    DnsSlot* slots = dnsSlots();
+    for (int8_t i = 0; i < ASYNC_HTTPSCLIENT_DNS_SLOTS; i++) {
+      uint8_t st = slots[i].state;
+      bool reusable = st == DNS_FREE || (st != DNS_PENDING && slots[i].abandoned);
+      if (!reusable) continue;
+      if (n >= sizeof(slots[i].host)) return -1;
+      memcpy(slots[i].host, host, n + 1);
+      slots[i].ip = 0;
+      slots[i].abandoned = false;
+      slots[i].state = DNS_PENDING;
+#if defined(ESP32)
+      // lwIP runs in its own task on ESP32; start the query there.
+      if (tcpip_callback(&BasicAsyncHttpsClient::dnsStart, &slots[i]) != ERR_OK) {
+        slots[i].state = DNS_FREE;
+        return -1;
+      }
+#else
+      dnsStart(&slots[i]);
+#endif
+      return i;
+    }
+    return -1;
+  }
+
+  static void dnsStart(void* arg) {
+    DnsSlot* slot = (DnsSlot*)arg;
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(slot->host, &addr, &BasicAsyncHttpsClient::dnsFound, slot);
+    if (err == ERR_OK) dnsFound(slot->host, &addr, slot);  // cached
+    else if (err != ERR_INPROGRESS) dnsFound(slot->host, nullptr, slot);
+  }
+
+  static void dnsFound(const char*, const ip_addr_t* addr, void* arg) {
+    DnsSlot* slot = (DnsSlot*)arg;
+    if (addr && IP_IS_V4(addr)) slot->ip = ip4_addr_get_u32(ip_2_ip4(addr));
+    if (slot->abandoned) {
+      slot->state = DNS_FREE;
+      return;
+    }
+    slot->state = addr ? DNS_DONE : DNS_FAILED;
+  }
 #else
-            int n = _client.read(bufLocal, want);
+  // No lwIP: the transport's connect() resolves the name.
+  static int8_t startDnsLookup(const char*) { return -1; }
 #endif
-            if (n <= 0) break;
 
-            if (!onBodyChunk(bufLocal, (size_t)n)) { fail(_bodyOverflow ? "body exceeded maxBodyBytes" : "body handler aborted"); return; }
-            _chunkRemaining -= (size_t)n;
-            AHC_DEBUG("CHUNK: wrote %d bytes (remain=%u)", n, (unsigned)_chunkRemaining);
-          }
+  void releaseDnsSlot() {
+    if (_dnsSlot < 0) return;
+    DnsSlot& slot = dnsSlots()[_dnsSlot];
+    slot.abandoned = true;  // a pending callback frees it
+    if (slot.state != DNS_PENDING) slot.state = DNS_FREE;
+    _dnsSlot = -1;
+  }
+
+  // -------- Request segments --------
+  void addTx(const char* data, size_t len, bool progmem = false) {
+    if (len == 0 || _txCount >= kMaxTxSegments) return;
+    _tx[_txCount].data = data;
+    _tx[_txCount].len = len;
+    _tx[_txCount].progmem = progmem;
+    _txCount++;
+  }
+
+  void addTxP(PGM_P data) { addTx(data, strlen_P(data), true); }
+
+  size_t txTotal() const {
+    size_t n = 0;
+    for (uint8_t i = 0; i < _txCount; i++) n += _tx[i].len;
+    return n;
+  }
+
+  // Copy pending bytes from the cursor into dst without consuming them. Stops
+  // before a large RAM segment so that one can be written in place.
+  size_t gatherTx(uint8_t* dst, size_t cap) const {
+    size_t n = 0;
+    size_t off = _txOffset;
+    for (uint8_t i = _txIndex; i < _txCount && n < cap; i++, off = 0) {
+      const TxSegment& seg = _tx[i];
+      if (i != _txIndex && !seg.progmem && seg.len >= cap) break;
+      size_t take = min(seg.len - off, cap - n);
+      if (seg.progmem) memcpy_P(dst + n, seg.data + off, take);
+      else memcpy(dst + n, seg.data + off, take);
+      n += take;
+    }
+    return n;
+  }
+
+  void advanceTx(size_t n) {
+    while (n > 0 && _txIndex < _txCount) {
+      size_t left = _tx[_txIndex].len - _txOffset;
+      if (n < left) {
+        _txOffset += n;
+        return;
+      }
+      n -= left;
+      _txIndex++;
+      _txOffset = 0;
+    }
+  }
+
+  void releaseRequestBody() {
+    _reqBody = String();  // frees a moved-in or copied payload right after SEND
+  }
+
+  // -------- Body store --------
+  bool reserveBody(size_t cap) {
+    if (cap <= _bodyCap) return true;
+    if (!_body.reserve(cap)) {
+      _bodyNoMem = true;
+      return false;
+    }
+    _bodyCap = cap;
+    return true;
+  }
+
+  void failBodyAborted() {
+    if (_bodyOverflow) fail("body exceeded maxBodyBytes");
+    else if (_bodyNoMem) fail("out of memory for body");
+    else fail("body handler aborted");
+  }
+
+  // HTTP/1.1 message length rules (RFC 9112 section 6.3).
+  bool isInterimStatus() const {
+    return _httpStatus >= 100 && _httpStatus < 200 && _httpStatus != 101;
+  }
+
+  bool responseHasBody() const {
+    if (_method == M_HEAD) return false;
+    if ((_httpStatus >= 100 && _httpStatus < 200) || _httpStatus == 204 || _httpStatus == 304) return false;
+    if (_chunked) return true;
+    return _contentLength != 0;
+  }
+
+  // -------- Chunked decoding (buffered, framing parsed in place) --------
+  enum ChunkState : uint8_t { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_CRLF, CHUNK_TRAILER, CHUNK_DONE };
 
+  void stepReadChunkedBody() {
+    uint8_t bufLocal[768 + 1];  // +1: see onBodyChunk()
+    const size_t bufSz = min<size_t>(_opt.ioChunkSize, sizeof(bufLocal) - 1);
+
+    while (_chunkState != CHUNK_DONE) {
+      if (_rxHead == _rxTail) {
+        // Inside a large chunk: read payload straight into the IO buffer.
+        if (_chunkState == CHUNK_DATA) {
+          size_t want = min(min(_chunkRemaining, bufSz), bufferedAvailable());
+          if (want == 0) break;
+          int n = readClient(bufLocal, want);
+          if (n <= 0) break;
+          if (!deliverChunkData(bufLocal, (size_t)n)) return;
+          _chunkRemaining -= (size_t)n;
           if (_chunkRemaining == 0) _chunkState = CHUNK_CRLF;
-        } break;
+          continue;
+        }
+        if (fillRx() == 0) break;
+      }
 
-        case CHUNK_CRLF: {
-          // Expect \r\n after chunk data; tolerate extra CRLF
-          if (ch == '\n') _chunkState = CHUNK_SIZE;
-        } break;
+      // Decode the buffered block. Payload bytes are compacted over the
+      // framing so several small chunks reach onBodyChunk() as one run.
+      uint8_t* p = _rx + _rxHead;
+      uint8_t* end = _rx + _rxTail;
+      uint8_t* run = p;
+      uint8_t* out = p;
+
+      while (p < end && _chunkState != CHUNK_DONE) {
+        switch (_chunkState) {
+          case CHUNK_SIZE: {
+            char ch = char(*p++);
+            int d = hexDigit(ch);
+            if (++_chunkLineLen > 64) { fail("chunk size line too long"); return; }
+            if (d >= 0) {
+              if (_chunkRemaining > (SIZE_MAX >> 4)) { fail("chunk size too large"); return; }
+              _chunkRemaining = (_chunkRemaining << 4) | size_t(d);
+              _chunkDigits++;
+            } else if (ch == '\n') {
+              if (!endChunkSizeLine()) return;
+            } else if (ch == ';' || ch == '\r' || ch == ' ' || ch == '\t') {
+              // ignore chunk extensions: "A;ext=1"
+              _chunkState = CHUNK_EXT;
+            } else {
+              fail("bad chunk size");
+              return;
+            }
+          } break;
+
+          case CHUNK_EXT: {
+            uint8_t* nl = (uint8_t*)memchr(p, '\n', size_t(end - p));
+            size_t skipped = size_t((nl ? nl : end) - p);
+            _chunkLineLen += skipped;
+            if (_chunkLineLen > 64) { fail("chunk size line too long"); return; }
+            p += skipped;
+            if (nl) {
+              p++;
+              if (!endChunkSizeLine()) return;
+            }
+          } break;
+
+          case CHUNK_DATA: {
+            size_t n = min(_chunkRemaining, size_t(end - p));
+            if (out != p) memmove(out, p, n);
+            out += n;
+            p += n;
+            _chunkRemaining -= n;
+            if (_chunkRemaining == 0) _chunkState = CHUNK_CRLF;
+          } break;
+
+          case CHUNK_CRLF: {
+            // Expect \r\n after chunk data; tolerate extra CRLF
+            if (*p++ == '\n') {
+              _chunkState = CHUNK_SIZE;
+              _chunkLineLen = 0;
+              _chunkDigits = 0;
+            }
+          } break;
+
+          case CHUNK_TRAILER: {
+            // Trailer fields are skipped; the message ends at the first empty line.
+            uint8_t* nl = (uint8_t*)memchr(p, '\n', size_t(end - p));
+            uint8_t* stop = nl ? nl : end;
+            _headerBytes += size_t(stop - p) + (nl ? 1 : 0);
+            if (_headerBytes > _opt.maxHeaderBytes) { fail("trailers too large"); return; }
+            for (; p < stop; p++) {
+              if (*p != '\r') _chunkLineLen = 1;
+            }
+            if (nl) {
+              p++;
+              if (_chunkLineLen == 0) {
+                _chunkState = CHUNK_DONE;
+              }
+              _chunkLineLen = 0;
+            }
+          } break;
 
-        case CHUNK_DONE: {
-          // Some servers send trailing headers after 0-chunk; we can just finish on close.
-          // If connection closes, we finish.
-          // If it stays open, we still treat DONE when no more bytes and not connected.
-        } break;
+          case CHUNK_DONE:
+            break;
+        }
       }
+
+      _rxHead = uint16_t(p - _rx);
+      if (out > run && !deliverChunkData(run, size_t(out - run))) return;
     }
 
-    if (!_client.connected() && !_client.available()) {
+    if (_chunkState == CHUNK_DONE) {
+      // Anything still buffered belongs to the next response on this socket.
       AHC_DEBUG("CHUNK: body complete (status=%d)", _httpStatus);
       finalizeResponse();
+      return;
+    }
+
+    if (!_client->connected() && !bufferedAvailable()) {
+      if (_chunkState == CHUNK_TRAILER) {
+        // Server closed right after the terminal chunk; nothing is missing.
+        AHC_DEBUG("CHUNK: closed in trailer (status=%d)", _httpStatus);
+        finalizeResponse();
+      } else {
+        fail("closed during chunked body");
+      }
+    }
+  }
+
+  bool endChunkSizeLine() {
+    if (_chunkDigits == 0) {
+      fail("bad chunk size");
+      return false;
+    }
+    if (_chunkRemaining == 0) {
+      _chunkState = CHUNK_TRAILER;
+      _chunkLineLen = 0;
+      AHC_DEBUG("CHUNK: terminal chunk reached");
+    } else {
+      AHC_DEBUG("CHUNK: size=%u", (unsigned)_chunkRemaining);
+      _chunkState = CHUNK_DATA;
+    }
+    return true;
+  }
+
+  bool deliverChunkData(const uint8_t* data, size_t len) {
+    if (!onBodyChunk(data, len)) {
+      failBodyAborted();
+      return false;
+    }
+    _bodyBytesRead += len;
+    AHC_DEBUG("CHUNK: wrote %u bytes", (unsigned)len);
+    return true;
+  }
+
+  // -------- Receive buffer --------
+  // Compact the scratch buffer and pull as much as the socket has ready. A
+  // transport that hands out small fragments is read until it runs dry, so
+  // the line scan runs once per fill rather than once per fragment.
+  size_t fillRx() {
+    if (_rxHead > 0) {
+      memmove(_rx, _rx + _rxHead, _rxTail - _rxHead);
+      _rxTail -= _rxHead;
+      _rxHead = 0;
+    }
+    size_t got = 0;
+    for (;;) {
+      size_t space = ASYNC_HTTPSCLIENT_RX_BUFFER - _rxTail;
+      int avail = _client->available();
+      if (space == 0 || avail <= 0) break;
+      int n = _client->read(_rx + _rxTail, min(space, (size_t)avail));
+      if (n <= 0) break;
+      _rxTail += (uint16_t)n;
+      got += (size_t)n;
     }
+    if (got) noteReceived(got);
+    return got;
+  }
+
+  int readClient(uint8_t* dst, size_t len) {
+    int n = _client->read(dst, len);
+    if (n > 0) noteReceived((size_t)n);
+    return n;
+  }
+
+  void noteReceived(size_t n) {
+    uint32_t now = millis();
+    if (_awaitingFirstByte) _tm.ttfbMs = ms16(now - _ioT0);
+    _tm.bytesIn += n;
+    _ioT0 = now;
+    _awaitingFirstByte = false;
+  }
+
+  // Bytes left over in the scratch buffer are consumed before the socket.
+  size_t bufferedAvailable() {
+    int avail = _client->available();
+    return size_t(_rxTail - _rxHead) + (avail > 0 ? (size_t)avail : 0);
+  }
+
+  int readBuffered(uint8_t* dst, size_t len) {
+    size_t buffered = _rxTail - _rxHead;
+    if (buffered == 0) return readClient(dst, len);
+    size_t n = min(len, buffered);
+    memcpy(dst, _rx + _rxHead, n);
+    _rxHead += (uint16_t)n;
+    return (int)n;
+  }
+
+  // -------- Header arena --------
+  // Names and values are packed NUL-terminated from the front of the arena;
+  // the (offset,len) table grows down from the back. Reset is two stores.
+  struct HeaderEntry { uint16_t name, nameLen, value, valueLen; };
+
+  bool prepareHeaderArena() {
+    if (!_opt.keepHeaders) {
+      // Streaming via onHeader() only: give the arena memory back.
+      _hdrOwned.reset();
+      _hdrOwnedCap = 0;
+      _hdrArena = nullptr;
+      _hdrCap = 0;
+      return true;
+    }
+    if (_hdrUser) {
+      _hdrArena = _hdrUser;
+      _hdrCap = min<size_t>(_hdrUserCap, 0xFFFF);
+      return true;
+    }
+    size_t want = min<size_t>(_opt.maxHeaderBytes, 0xFFFF);
+    if (!_hdrOwned || _hdrOwnedCap != want) {
+      _hdrOwned.reset(new (std::nothrow) char[want]);
+      _hdrOwnedCap = _hdrOwned ? want : 0;
+    }
+    _hdrArena = _hdrOwned.get();
+    _hdrCap = _hdrOwnedCap;
+    return _hdrArena != nullptr;
+  }
+
+  bool storeHeader(const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    size_t need = nameLen + valueLen + 2;
+    size_t table = (_hdrCount + 1) * sizeof(HeaderEntry);
+    if (!_hdrArena || table > _hdrCap || _hdrUsed + need > _hdrCap - table) return false;
+    size_t tableStart = _hdrCap - table;
+    HeaderEntry e;
+    e.name = (uint16_t)_hdrUsed;
+    e.nameLen = (uint16_t)nameLen;
+    e.value = (uint16_t)(_hdrUsed + nameLen + 1);
+    e.valueLen = (uint16_t)valueLen;
+    memcpy(_hdrArena + e.name, name, nameLen);
+    _hdrArena[e.name + nameLen] = '\0';
+    memcpy(_hdrArena + e.value, value, valueLen);
+    _hdrArena[e.value + valueLen] = '\0';
+    // Arena may be caller-supplied and unaligned: copy entries bytewise.
+    memcpy(_hdrArena + tableStart, &e, sizeof(e));
+    _hdrUsed += need;
+    _hdrCount++;
+    return true;
+  }
+
+  HeaderEntry headerEntry(size_t i) const {
+    HeaderEntry e;
+    memcpy(&e, _hdrArena + _hdrCap - (i + 1) * sizeof(HeaderEntry), sizeof(e));
+    return e;
+  }
+
+  HeaderView view(uint16_t off, uint16_t len) const {
+    HeaderView v;
+    v.data = _hdrArena + off;
+    v.len = len;
+    return v;
   }
 
   // -------- Helpers --------
-  static bool startsWithNoCase(const String& s, const char* prefix) {
-    size_t n = strlen(prefix);
-    if (s.length() < n) return false;
+  static const char* methodName(Method m) {
+    switch (m) {
+      case M_POST: return "POST";
+      case M_HEAD: return "HEAD";
+      default:     return "GET";
+    }
+  }
+
+  static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+  static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  static char toLowerAscii(char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; }
+
+  static bool equalsNoCase(const char* s, size_t len, const char* name) {
+    size_t n = strlen(name);
+    if (len != n) return false;
     for (size_t i = 0; i < n; i++) {
-      char a = s[i], b = prefix[i];
-      if (a >= 'A' && a <= 'Z') a = char(a - 'A' + 'a');
-      if (b >= 'A' && b <= 'Z') b = char(b - 'A' + 'a');
-      if (a != b) return false;
+      if (toLowerAscii(s[i]) != toLowerAscii(name[i])) return false;
     }
     return true;
   }
 
-  static bool containsNoCase(const String& s, const char* needle) {
-    String hay = s; hay.toLowerCase();
-    String ned = needle; ned.toLowerCase();
-    return hay.indexOf(ned) >= 0;
+  static bool containsNoCase(const char* s, size_t len, const char* needle) {
+    size_t n = strlen(needle);
+    for (size_t i = 0; i + n <= len; i++) {
+      size_t j = 0;
+      while (j < n && toLowerAscii(s[i + j]) == toLowerAscii(needle[j])) j++;
+      if (j == n) return true;
+    }
+    return false;
+  }
+
+  // Numeric parameter of a Keep-Alive header value, or -1.
+  static int32_t keepAliveParam(const char* s, size_t len, const char* key) {
+    size_t n = strlen(key);
+    size_t i = 0;
+    while (i < len) {
+      while (i < len && (isSpace(s[i]) || s[i] == ',')) i++;
+      size_t end = i;
+      while (end < len && s[end] != ',') end++;
+      if (end - i > n && s[i + n] == '=' && equalsNoCase(s + i, n, key)) {
+        return parseContentLength(s + i + n + 1, end - i - n - 1);
+      }
+      i = end;
+    }
+    return -1;
+  }
+
+  static int32_t parseContentLength(const char* s, size_t len) {
+    int32_t v = 0;
+    size_t i = 0;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+      if (v > (INT32_MAX - 9) / 10) return -1;
+      v = v * 10 + (s[i] - '0');
+    }
+    return i == 0 ? -1 : v;
   }
 
   String tlsErrorDetail() {
-#if defined(ESP8266)
-    char buf[128];
-    int code = _client.getLastSSLError(buf, sizeof(buf));
-    if (code == 0) return "";
-    String detail = F(" (ssl ");
-    detail += code;
-    detail += F(": ");
-    detail += buf;
-    detail += ')';
-    return detail;
-#elif defined(ESP32)
     char buf[128];
-    int code = _client.lastError(buf, sizeof(buf));
+    buf[0] = 0;
+    int code = _client->lastError(buf, sizeof(buf));
     if (code == 0) return "";
     String detail = F(" (ssl ");
     detail += code;
@@ -528,54 +2229,215 @@ private:
     }
     detail += ')';
     return detail;
-#else
-    return "";
-#endif
   }
 
   void fail(const char* msg) {
-    logStageDuration("ERROR");
+    endTimings(_state, false);
     AHC_DEBUG("FAIL: %s", msg);
+    _errStage = _state;
+    releaseDnsSlot();
+    releaseRequestBody();
     _err = msg;
     _state = ERROR;
-    _client.stop();
+    dropSocket();
   }
   void fail(const String& msg) {
-    logStageDuration("ERROR");
+    endTimings(_state, false);
     AHC_DEBUG("FAIL: %s", msg.c_str());
+    _errStage = _state;
+    releaseDnsSlot();
+    releaseRequestBody();
     _err = msg;
     _state = ERROR;
-    _client.stop();
+    dropSocket();
   }
 
-#if ASYNC_HTTPSCLIENT_DEBUG
-  void logStageDuration(const char* tag) {
+  // Per-response state; the socket and any bytes already buffered are kept.
+  void resetResponse() {
+    _hdrUsed = 0;
+    _hdrCount = 0;
+    _err = "";
+    _errStage = IDLE;
+    _httpStatus = -1;
+    _body = "";
+    _bodyOverflow = false;
+    _bodyNoMem = false;
+    _userBodyLen = 0;
+    _headerBytes = 0;
+    _contentLength = -1;
+    _chunked = false;
+    _seenHeaderEnd = false;
+    _chunkState = CHUNK_SIZE;
+    _chunkRemaining = 0;
+    _chunkLineLen = 0;
+    _chunkDigits = 0;
+    _serverRequestedClose = false;
+    _kaTimeoutS = -1;
+    _kaMax = -1;
+    _bodyBytesRead = 0;
+  }
+
+  // A reused keep-alive socket the server had already dropped: retry an
+  // idempotent request once on a new connection instead of failing it.
+  // Only while no response byte at all has arrived (not even a partial
+  // status line), so a half-received response is never replayed.
+  bool retryOnFreshSocket(const char* why) {
+    if (!_socketReused || _retried || _tm.bytesIn > 0 || _streamBody ||
+        (_method != M_GET && _method != M_HEAD)) {
+      return false;
+    }
+    AHC_DEBUG("KEEP-ALIVE: stale socket (%s), retrying on a new connection", why);
+    (void)why;
+    _retried = true;
+    _socketReused = false;
+    _tm.reused = false;
+    dropSocket();
+    _txIndex = 0;
+    _txOffset = 0;
+    _txSent = 0;
+    _tm.bytesOut = 0;
+    _rxHead = 0;
+    _rxTail = 0;
+    _state = DNS_RESOLVE;
+    return true;
+  }
+
+  // Follow-up request for pipelineGet(); same headers as the first one.
+  void appendGetRequest(String& out, const String& path) const {
+    out += F("GET ");
+    out += path;
+    out += F(" HTTP/1.1\r\nHost: ");
+    out += _host;
+    out += F("\r\nUser-Agent: esp-secure/1.0\r\nAccept: */*\r\nConnection: keep-alive\r\n");
+    if (_extraHeaders.length() > 0) {
+      out += _extraHeaders;
+      if (!_extraHeaders.endsWith("\r\n")) out += F("\r\n");
+    }
+    out += F("\r\n");
+  }
+
+  // -------- Deadlines --------
+  uint16_t connectTimeout() const {
+    return Transport::kOneSocketTimeout ? _opt.tlsHandshakeTimeout : _opt.connectTimeoutMs;
+  }
+
+  // Total budget plus the per-stage limits that poll() can observe; DNS has
+  // its own in stepResolve() and connect() is bounded by the transport.
+  bool checkDeadlines() {
+    uint32_t now = millis();
+    if (_opt.timeoutMs && now - _t0 > _opt.timeoutMs) {
+      AHC_DEBUG("timeout after %lu ms (state=%d)", (unsigned long)(now - _t0), _state);
+      fail("timeout");
+      return false;
+    }
+    if (_state == SEND || _state == READ_HEADERS || _state == READ_BODY) {
+      bool first = _awaitingFirstByte && _state != SEND;
+      uint16_t limit = first ? _opt.firstByteTimeoutMs : _opt.idleTimeoutMs;
+      if (limit && now - _ioT0 > limit) {
+        AHC_DEBUG("%s after %lu ms (state=%d)", first ? "no response" : "stalled",
+                  (unsigned long)(now - _ioT0), _state);
+        fail(first ? "first byte timeout" : "idle timeout");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // -------- Socket ownership --------
+  bool keepAlive() const { return _opt.keepAlive || _pool; }
+
+  // Take a pooled connection for _host:_port. A live one goes straight to
+  // SEND; a fresh one is connected by stepConnect().
+  bool acquirePooled() {
+    Transport* c = _pool->acquire(_host, _port);
+    if (!c) return false;
+    _client = c;
+    if (c->connected()) {
+      AHC_DEBUG("POOL: idle connection to %s:%u, moving to SEND", _host.c_str(), _port);
+      _socketReused = true;
+      _tm.reused = true;
+      markStage(CONNECT);
+      _ioT0 = millis();
+      _state = SEND;
+    }
+    return true;
+  }
+
+  // Close the socket, or return a pooled one (kept open when keep is set).
+  void dropSocket(bool keep = false) {
+    _connecting = false;
+    _connSession = nullptr;
+    if (_client != &_ownClient) {
+      _pool->release(_client, keep, _connIdleMs);
+      _client = &_ownClient;
+      return;
+    }
+    if (!keep) _client->stop();
+  }
+
+  // -------- Timings --------
+  static uint16_t ms16(uint32_t ms) { return ms > 0xFFFF ? 0xFFFF : (uint16_t)ms; }
+
+  // Close the stage that just finished and start timing the next one.
+  void markStage(State finished) {
     uint32_t now = millis();
-    uint32_t delta = (_stageT0 == 0) ? 0 : now - _stageT0;
-    AHC_DEBUG("%s took %lu ms", tag, (unsigned long)delta);
+    uint32_t ms = (_stageT0 == 0) ? 0 : now - _stageT0;
     _stageT0 = now;
+    AHC_DEBUG("state %d took %lu ms", finished, (unsigned long)ms);
+    switch (finished) {
+      case DNS_RESOLVE:  _tm.dnsMs = ms16(ms); break;
+      case SEND:         _tm.sendMs = ms16(ms); break;
+      case READ_HEADERS: _tm.headersMs = ms16(ms > _tm.ttfbMs ? ms - _tm.ttfbMs : 0); break;
+      case READ_BODY:    _tm.bodyMs = ms; break;
+      default: break;  // CONNECT is split into tcpMs/tlsMs by stepConnect()
+    }
+  }
+
+  // The request is over: close its last stage and the total.
+  void endTimings(State last, bool ok) {
+    bool started = _stageT0 != 0;
+    _tm.totalMs = started ? millis() - _t0 : 0;
+    markStage(last);
+    if (_stats && started) _stats->record(_host.c_str(), _tm, ok, last);
   }
-#else
-  void logStageDuration(const char*) {}
-#endif
 
   void finalizeResponse() {
-    bool keepSocket = _opt.keepAlive && !_serverRequestedClose && _client.connected();
+    if (_opt.tlsResume && Transport::kResumesSessions) {
+      // Some stacks only learn the resumable session after the handshake
+      // (TLS 1.3 tickets); take the latest one while the connection is ours.
+      TlsSessionEntry* e = tlsSessionFor(_host, _port);
+      if (_client->saveSession(e->session)) e->valid = true;
+    }
+    bool keepSocket = keepAlive() && !_serverRequestedClose && _client->connected();
+    if (_kaMax == 0) keepSocket = false;  // server's last request on this connection
+    // Treat the socket as dead a second before the server's idle timer fires.
+    // Without a hint it is kept until the server closes it, unless the caller
+    // assumes a window.
+    _connLastUse = millis();
+    _connIdleMs = _kaTimeoutS > 1 ? uint32_t(_kaTimeoutS - 1) * 1000
+                : _kaTimeoutS >= 0 ? 0
+                : _opt.keepAliveIdleMs ? _opt.keepAliveIdleMs : UINT32_MAX;
     if (!keepSocket) {
-      _client.stop();
-      if (_opt.keepAlive) {
+      if (keepAlive()) {
         AHC_DEBUG("KEEP-ALIVE: socket closed (requested=%d connected=%d)",
-                  _serverRequestedClose ? 1 : 0, _client.connected());
+                  _serverRequestedClose ? 1 : 0, _client->connected());
       }
+      dropSocket();
     } else {
       AHC_DEBUG("KEEP-ALIVE: socket preserved for next request");
+      // A pooled socket still owed pipelined responses stays with us.
+      if (_pool && !(_pipeQueued > 0 && _pipeOnSocket)) dropSocket(true);
     }
-    logStageDuration("BODY");
+    if (!keepSocket) _pipeOnSocket = false;
+    endTimings(READ_BODY, true);
     _state = DONE;
   }
 
 private:
-  SecureClientT _client;
+  Transport _ownClient;
+  Transport* _client = &_ownClient;  // _ownClient or a connection lent by _pool
+  BasicAsyncHttpsPool<Transport>* _pool = nullptr;
+  AsyncHttpsStats* _stats = nullptr;
   Options _opt;
 
   Method _method = M_GET;
@@ -589,19 +2451,46 @@ private:
   bool _hasCa = false;
 
   time_t _nowEpoch = 0;
+  uint32_t _timeSetMs = 0;  // millis() when _nowEpoch was set
   bool _hasTime = false;
 
-#if defined(ESP8266)
-  // Trust anchors for BearSSL
-  std::unique_ptr<BearSSL::X509List> _ta;
-#endif
+  // Request segments (pointers into the strings below, literals or the body)
+  struct TxSegment {
+    const char* data;
+    size_t len;
+    bool progmem;
+  };
+  static const uint8_t kMaxTxSegments = 16;
+  TxSegment _tx[kMaxTxSegments];
+  uint8_t _txCount = 0;
+  uint8_t _txIndex = 0;
+  uint8_t _txBodySeg = 0xFF;
+  size_t _txOffset = 0;
+  size_t _txSent = 0;
+  String _extraHeaders;
+  String _contentType;
+  String _reqBody;
+  char _txLenDigits[11];
+
+  // Streamed request body (beginPostStream); buffer allocated once, kept
+  static const size_t kFrameHead = 10;  // room for up to 8 hex digits + CRLF
+  std::unique_ptr<uint8_t[]> _streamBuf;
+  bool _streamBody = false;
+  bool _streamChunked = false;
+  bool _streamEnded = false;
+  size_t _streamPos = 0;
+  size_t _streamLen = 0;
+  size_t _streamRemaining = 0;
 
   // Request/Response parsing
-  String _req;
-  String _line;
   String _err;
   String _body;
   bool _bodyOverflow = false;
+  bool _bodyNoMem = false;
+  size_t _bodyCap = 0;  // capacity we reserved; reset() keeps the allocation
+  uint8_t* _userBody = nullptr;  // caller buffer (setBodyBuffer)
+  size_t _userBodyCap = 0;
+  size_t _userBodyLen = 0;
 
   int _httpStatus = -1;
 
@@ -610,13 +2499,297 @@ private:
   bool _chunked = false;
   bool _seenHeaderEnd = false;
   bool _serverRequestedClose = false;
+  int32_t _kaTimeoutS = -1;  // Keep-Alive: timeout= of this response (-1 = none)
+  int32_t _kaMax = -1;       // Keep-Alive: max= (requests left on the connection)
   size_t _bodyBytesRead = 0;
 
+  // Kept-alive connection bookkeeping
+  uint32_t _connLastUse = 0;
+  uint32_t _connIdleMs = 0;
+  bool _socketReused = false;  // this request went out on a kept-alive socket
+  bool _retried = false;
+
   uint32_t _t0 = 0;
   uint32_t _stageT0 = 0;
+  uint32_t _ioT0 = 0;              // last send/receive progress
+  bool _awaitingFirstByte = false;
+  State _errStage = IDLE;
+
+  // CONNECT
+  uint32_t _handshakeMs = 0;
+  bool _sessionResumed = false;
+  Timings _tm = Timings();
+  bool _connecting = false;        // connect() returned PENDING
+  uint32_t _hsT0 = 0;
+  TlsSessionEntry* _connSession = nullptr;  // offered to the connect in progress
+  TlsSessionEntry _tlsSessions[ASYNC_HTTPSCLIENT_TLS_SESSIONS];
+
+  // DNS_RESOLVE
+  int8_t _dnsSlot = -1;
+  uint32_t _dnsT0 = 0;
+  uint32_t _resolvedIp = 0;  // IPv4, network byte order; 0 if unknown
+  bool _resolvedCached = false;  // _resolvedIp came from _ipAddr, not a lookup
+  String _ipHost;             // last successful lookup, kept across requests
+  uint32_t _ipAddr = 0;
+  uint32_t _ipExpires = 0;    // epoch
+
+  // Pipelining (pipelineGet): follow-up paths, '\n'-terminated, in send order
+  String _pipePaths;
+  String _pipeTx;                // their request bytes, one tx segment
+  uint8_t _pipeSeg = 0xFF;
+  uint8_t _pipeQueued = 0;       // responses not yet started
+  bool _pipeOnSocket = false;    // follow-ups were written on this connection
+  bool _pipeResend = false;      // nextPipelined() fallback in progress
+
+  // Receive scratch: header lines are parsed in place, leftovers feed the body.
+  uint8_t  _rx[ASYNC_HTTPSCLIENT_RX_BUFFER + 1];  // +1: see onBodyChunk()
+  uint16_t _rxHead = 0;
+  uint16_t _rxTail = 0;
+
+  // Response header arena (heap-owned or caller-supplied)
+  std::unique_ptr<char[]> _hdrOwned;
+  size_t _hdrOwnedCap = 0;
+  char*  _hdrUser = nullptr;
+  size_t _hdrUserCap = 0;
+  char*  _hdrArena = nullptr;
+  size_t _hdrCap = 0;
+  size_t _hdrUsed = 0;
+  size_t _hdrCount = 0;
 
   // chunked
   ChunkState _chunkState = CHUNK_SIZE;
-  String _chunkLine;
   size_t _chunkRemaining = 0;
+  uint16_t _chunkLineLen = 0;  // bytes of the current size line (capped at 64)
+  uint8_t _chunkDigits = 0;
+};
+
+// Queue of requests run over ASYNC_HTTPSCLIENT_SCHED_WORKERS clients that
+// share one connection pool. poll() starts queued requests as soon as a
+// client frees up and pumps every running one, so loop() needs no state
+// machine of its own.
+template <class Transport>
+class BasicAsyncHttpsScheduler {
+public:
+  using Client = BasicAsyncHttpsClient<Transport>;
+  using Pool = BasicAsyncHttpsPool<Transport>;
+
+  // Called once per request. error is nullptr on success; client is the one
+  // that ran it (read status(), body(), header() there) or nullptr if the
+  // request expired before it could start.
+  using Callback = std::function<void(uint32_t id, Client* client, const char* error)>;
+
+  struct Request {
+    typename Client::Method method = Client::M_GET;
+    String host;
+    uint16_t port = 443;
+    String path;
+    String body;  // POST only; moved into the client
+    String contentType = "application/json";
+    String extraHeaders;
+    uint8_t priority = 0;     // higher runs first
+    uint32_t deadlineMs = 0;  // from enqueue to completion (0 = none)
+  };
+
+  BasicAsyncHttpsScheduler() {
+    for (auto& w : _workers) w.client.setPool(&_pool);
+  }
+
+  // Forwarded to every client.
+  void setCACert(const char* caPem) {
+    for (auto& w : _workers) w.client.setCACert(caPem);
+  }
+  void setUnixTime(time_t nowEpoch) {
+    for (auto& w : _workers) w.client.setUnixTime(nowEpoch);
+  }
+  void setOptions(const typename Client::Options& opt) {
+    for (auto& w : _workers) w.client.setOptions(opt);
+  }
+  void setPoolOptions(const typename Pool::Options& opt) { _pool.setOptions(opt); }
+  void setStats(AsyncHttpsStats* stats) {
+    for (auto& w : _workers) w.client.setStats(stats);
+  }
+  const Pool& pool() const { return _pool; }
+
+  // Returns the request id, or 0 if the queue is full.
+  uint32_t enqueue(Request&& req, Callback cb) {
+    for (auto& j : _queue) {
+      if (j.id) continue;
+      j.id = nextId();
+      j.seq = _seq++;
+      j.due = millis() + req.deadlineMs;
+      j.req = std::move(req);
+      j.cb = std::move(cb);
+      AHC_DEBUG("SCHED: queued #%lu %s%s (prio %u)", (unsigned long)j.id,
+                j.req.host.c_str(), j.req.path.c_str(), j.req.priority);
+      return j.id;
+    }
+    AHC_DEBUG("SCHED: queue full");
+    return 0;
+  }
+
+  uint32_t get(const String& host, const String& path, Callback cb, uint8_t priority = 0) {
+    Request r;
+    r.host = host;
+    r.path = path;
+    r.priority = priority;
+    return enqueue(std::move(r), std::move(cb));
+  }
+
+  // Drop a queued request, or abort a running one. No callback is made.
+  bool cancel(uint32_t id) {
+    for (auto& j : _queue) {
+      if (j.id != id) continue;
+      j = Job();
+      return true;
+    }
+    for (auto& w : _workers) {
+      if (w.id != id) continue;
+      w.client.stop();
+      w.id = 0;
+      w.cb = nullptr;
+      return true;
+    }
+    return false;
+  }
+
+  // Requests waiting or running.
+  size_t pending() const {
+    size_t n = 0;
+    for (const auto& j : _queue) n += j.id != 0;
+    for (const auto& w : _workers) n += w.id != 0;
+    return n;
+  }
+  bool idle() const { return pending() == 0; }
+
+  // Pump everything: expire, dispatch, and poll each running client once.
+  // Clients are visited round-robin so none is always served first.
+  void poll() {
+    expireQueued();
+    for (size_t k = 0; k < ASYNC_HTTPSCLIENT_SCHED_WORKERS; k++) {
+      Worker& w = _workers[(_next + k) % ASYNC_HTTPSCLIENT_SCHED_WORKERS];
+      if (!w.id) dispatch(w);
+      if (!w.id) continue;
+      w.client.poll();
+      if (w.client.done()) {
+        complete(w, nullptr);
+      } else if (w.client.error()) {
+        complete(w, w.client.errorMsg().c_str());
+      } else if (w.hasDeadline && int32_t(millis() - w.due) >= 0) {
+        w.client.abortRequest("deadline exceeded");
+        complete(w, w.client.errorMsg().c_str());
+      }
+      if (!w.id) dispatch(w);  // keep the connection busy
+    }
+    _next = (_next + 1) % ASYNC_HTTPSCLIENT_SCHED_WORKERS;
+  }
+
+private:
+  struct Job {
+    uint32_t id = 0;  // 0 = free
+    uint32_t seq = 0;
+    uint32_t due = 0;
+    Request req;
+    Callback cb;
+  };
+
+  struct Worker {
+    Client client;
+    uint32_t id = 0;  // 0 = idle
+    uint32_t due = 0;
+    bool hasDeadline = false;
+    Callback cb;
+  };
+
+  uint32_t nextId() {
+    if (++_lastId == 0) _lastId = 1;
+    return _lastId;
+  }
+
+  // Highest priority first, then earliest deadline, then oldest.
+  Job* pickJob() {
+    Job* best = nullptr;
+    for (auto& j : _queue) {
+      if (!j.id) continue;
+      if (!best) {
+        best = &j;
+        continue;
+      }
+      if (j.req.priority != best->req.priority) {
+        if (j.req.priority > best->req.priority) best = &j;
+        continue;
+      }
+      bool jd = j.req.deadlineMs != 0, bd = best->req.deadlineMs != 0;
+      if (jd != bd) {
+        if (jd) best = &j;
+        continue;
+      }
+      if (jd && int32_t(j.due - best->due) != 0) {
+        if (int32_t(j.due - best->due) < 0) best = &j;
+        continue;
+      }
+      if (int32_t(j.seq - best->seq) < 0) best = &j;
+    }
+    return best;
+  }
+
+  void dispatch(Worker& w) {
+    Job* j = pickJob();
+    if (!j) return;
+    w.id = j->id;
+    w.due = j->due;
+    w.hasDeadline = j->req.deadlineMs != 0;
+    w.cb = std::move(j->cb);
+    Request req = std::move(j->req);
+    *j = Job();
+
+    AHC_DEBUG("SCHED: starting #%lu", (unsigned long)w.id);
+    switch (req.method) {
+      case Client::M_POST:
+        w.client.beginPost(req.host, req.port, req.path, std::move(req.body),
+                           req.contentType, req.extraHeaders);
+        break;
+      case Client::M_HEAD:
+        w.client.beginHead(req.host, req.port, req.path, req.extraHeaders);
+        break;
+      default:
+        w.client.beginGet(req.host, req.port, req.path, req.extraHeaders);
+        break;
+    }
+    if (w.client.error()) complete(w, w.client.errorMsg().c_str());
+  }
+
+  // The callback may enqueue or cancel, so the worker is freed first.
+  void complete(Worker& w, const char* error) {
+    uint32_t id = w.id;
+    Callback cb = std::move(w.cb);
+    w.id = 0;
+    w.cb = nullptr;
+    AHC_DEBUG("SCHED: #%lu %s", (unsigned long)id, error ? error : "done");
+    if (cb) cb(id, &w.client, error);
+  }
+
+  void expireQueued() {
+    uint32_t now = millis();
+    for (auto& j : _queue) {
+      if (!j.id || !j.req.deadlineMs || int32_t(now - j.due) < 0) continue;
+      uint32_t id = j.id;
+      Callback cb = std::move(j.cb);
+      j = Job();
+      AHC_DEBUG("SCHED: #%lu expired in queue", (unsigned long)id);
+      if (cb) cb(id, nullptr, "deadline exceeded");
+    }
+  }
+
+  Pool _pool;  // declared before the workers, so it outlives them
+  Worker _workers[ASYNC_HTTPSCLIENT_SCHED_WORKERS];
+  Job _queue[ASYNC_HTTPSCLIENT_SCHED_QUEUE];
+  uint32_t _lastId = 0;
+  uint32_t _seq = 0;
+  size_t _next = 0;
 };
+
+#if defined(ESP8266) || defined(ESP32)
+using AsyncHttpsPool = BasicAsyncHttpsPool<EspTransport>;
+using AsyncHttpsClient = BasicAsyncHttpsClient<EspTransport>;
+using AsyncHttpsScheduler = BasicAsyncHttpsScheduler<EspTransport>;
+#endif
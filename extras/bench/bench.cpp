@@ -0,0 +1,326 @@
+// Host benchmark: BasicAsyncHttpsClient<PosixTlsTransport> against an HTTPS
+// server on 127.0.0.1 started in-process with a throwaway CA. Measures
+// requests per second, time to first byte and body throughput for
+// Content-Length, chunked and keep-alive workloads and prints one JSON
+// object per workload on stdout.
+//
+//   g++ -std=c++17 -O2 -g -I. -Iextras/host extras/bench/bench.cpp -o ahc-bench -lssl -lcrypto -lpthread
+//   ./ahc-bench [-t ms-per-workload] [-w workload-substring]
+#include "AsyncHttpsClient.h"
+#include "PosixTlsTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509v3.h>
+
+namespace {
+
+uint64_t nowUs() {
+  using namespace std::chrono;
+  return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// -------- Throwaway PKI --------
+EVP_PKEY* newKey() {
+  EVP_PKEY* key = nullptr;
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  EVP_PKEY_keygen_init(ctx);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(ctx, &key);
+  EVP_PKEY_CTX_free(ctx);
+  return key;
+}
+
+void addExt(X509* cert, X509V3_CTX* v3, int nid, const char* value) {
+  X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, v3, nid, value);
+  X509_add_ext(cert, ext, -1);
+  X509_EXTENSION_free(ext);
+}
+
+// Self-signed CA when issuer is null, otherwise a localhost server cert.
+X509* newCert(EVP_PKEY* key, const char* cn, X509* issuer, EVP_PKEY* issuerKey) {
+  X509* cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), issuer ? 2 : 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME* name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)cn, -1, -1, 0);
+  X509_set_issuer_name(cert, issuer ? X509_get_subject_name(issuer) : name);
+
+  X509V3_CTX v3;
+  X509V3_set_ctx_nodb(&v3);
+  X509V3_set_ctx(&v3, issuer ? issuer : cert, cert, nullptr, nullptr, 0);
+  if (issuer) {
+    addExt(cert, &v3, NID_basic_constraints, "CA:FALSE");
+    addExt(cert, &v3, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1");
+  } else {
+    addExt(cert, &v3, NID_basic_constraints, "critical,CA:TRUE");
+    addExt(cert, &v3, NID_key_usage, "critical,keyCertSign");
+  }
+  X509_sign(cert, issuer ? issuerKey : key, EVP_sha256());
+  return cert;
+}
+
+std::string toPem(X509* cert) {
+  BIO* bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_X509(bio, cert);
+  char* data = nullptr;
+  long len = BIO_get_mem_data(bio, &data);
+  std::string pem(data, (size_t)len);
+  BIO_free(bio);
+  return pem;
+}
+
+// -------- Loopback server --------
+// One connection at a time, blocking I/O. GET /b?n=<body bytes>&c=<chunk
+// bytes> answers with n bytes, chunked when c > 0. Responses are built once
+// per shape so the server stays cheap next to the client.
+class LoopbackServer {
+public:
+  bool start() {
+    EVP_PKEY* caKey = newKey();
+    X509* ca = newCert(caKey, "ahc-bench CA", nullptr, nullptr);
+    EVP_PKEY* key = newKey();
+    X509* cert = newCert(key, "localhost", ca, caKey);
+    caPem = toPem(ca);
+
+    _ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(_ctx, cert);
+    SSL_CTX_use_PrivateKey(_ctx, key);
+    X509_free(ca);
+    X509_free(cert);
+    EVP_PKEY_free(caKey);
+    EVP_PKEY_free(key);
+
+    _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(sa);
+    if (::bind(_fd, (sockaddr*)&sa, sizeof(sa)) != 0 || ::listen(_fd, 16) != 0 ||
+        getsockname(_fd, (sockaddr*)&sa, &len) != 0) {
+      return false;
+    }
+    port = ntohs(sa.sin_port);
+    _thread = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    ::shutdown(_fd, SHUT_RDWR);  // wakes accept()
+    _thread.join();
+    ::close(_fd);
+    SSL_CTX_free(_ctx);
+  }
+
+  std::string caPem;
+  uint16_t port = 0;
+
+private:
+  void run() {
+    for (;;) {
+      int fd = ::accept(_fd, nullptr, nullptr);
+      if (fd < 0) return;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      SSL* ssl = SSL_new(_ctx);
+      SSL_set_fd(ssl, fd);
+      if (SSL_accept(ssl) == 1) serve(ssl);
+      SSL_free(ssl);
+      ::close(fd);
+    }
+  }
+
+  void serve(SSL* ssl) {
+    std::string in;
+    char buf[4096];
+    for (;;) {
+      size_t end;
+      while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+        int n = SSL_read(ssl, buf, sizeof(buf));
+        if (n <= 0) return;
+        in.append(buf, (size_t)n);
+      }
+      std::string head = in.substr(0, end + 4);
+      in.erase(0, end + 4);
+
+      size_t n = 0, c = 0;
+      size_t q = head.find('?');
+      if (q != std::string::npos) sscanf(head.c_str() + q, "?n=%zu&c=%zu", &n, &c);
+      const std::string& resp = response(n, c);
+      for (size_t off = 0; off < resp.size();) {
+        int w = SSL_write(ssl, resp.data() + off, (int)std::min<size_t>(resp.size() - off, 1 << 20));
+        if (w <= 0) return;
+        off += (size_t)w;
+      }
+      if (head.find("Connection: close") != std::string::npos) {
+        SSL_shutdown(ssl);
+        return;
+      }
+    }
+  }
+
+  const std::string& response(size_t n, size_t c) {
+    std::string& r = _responses[std::make_pair(n, c)];
+    if (!r.empty()) return r;
+    r = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+        "Keep-Alive: timeout=30\r\n";
+    if (c == 0) {
+      r += "Content-Length: " + std::to_string(n) + "\r\n\r\n";
+      r.append(n, 'x');
+      return r;
+    }
+    r += "Transfer-Encoding: chunked\r\n\r\n";
+    char size[24];
+    for (size_t left = n; left > 0;) {
+      size_t k = std::min(left, c);
+      snprintf(size, sizeof(size), "%zx\r\n", k);
+      r += size;
+      r.append(k, 'x');
+      r += "\r\n";
+      left -= k;
+    }
+    r += "0\r\n\r\n";
+    return r;
+  }
+
+  int _fd = -1;
+  SSL_CTX* _ctx = nullptr;
+  std::thread _thread;
+  std::map<std::pair<size_t, size_t>, std::string> _responses;
+};
+
+// -------- Client side --------
+// Counts body bytes on the onBodyChunk() path and stamps the first header.
+class BenchClient : public HostHttpsClient {
+public:
+  uint64_t firstByteUs = 0;
+  uint64_t bodyBytes = 0;
+
+protected:
+  bool onHeader(const char* name, size_t nameLen, const char* value, size_t valueLen) override {
+    if (!firstByteUs) firstByteUs = nowUs();
+    return HostHttpsClient::onHeader(name, nameLen, value, valueLen);
+  }
+  bool onBodyChunk(const uint8_t* data, size_t len) override {
+    bodyBytes += len;
+    return HostHttpsClient::onBodyChunk(data, len);
+  }
+};
+
+struct Workload {
+  const char* name;
+  size_t bodyBytes;
+  size_t chunkBytes;  // 0 = Content-Length
+  bool keepAlive;
+};
+
+const Workload kWorkloads[] = {
+    {"content-length/new-connection", 0, 0, false},
+    {"content-length/keep-alive", 0, 0, true},
+    {"content-length/keep-alive", 1024, 0, true},
+    {"content-length/keep-alive", 16 * 1024, 0, true},
+    {"content-length/keep-alive", 256 * 1024, 0, true},
+    {"chunked/keep-alive", 16 * 1024, 1, true},
+    {"chunked/keep-alive", 16 * 1024, 16, true},
+    {"chunked/keep-alive", 16 * 1024, 256, true},
+    {"chunked/keep-alive", 16 * 1024, 4 * 1024, true},
+    {"chunked/keep-alive", 16 * 1024, 16 * 1024, true},
+};
+
+uint64_t percentile(std::vector<uint64_t>& v, double p) {
+  if (v.empty()) return 0;
+  size_t i = std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5));
+  std::nth_element(v.begin(), v.begin() + (long)i, v.end());
+  return v[i];
+}
+
+void runWorkload(const Workload& w, const LoopbackServer& server, uint32_t budgetMs) {
+  BenchClient client;
+  client.setCACert(server.caPem.c_str());
+  client.setUnixTime(time(nullptr));
+  HostHttpsClient::Options opt;
+  opt.keepAlive = w.keepAlive;
+  opt.maxBodyBytes = w.bodyBytes + 1;  // buffered body path, no overflow
+  opt.ioChunkSize = 2048;
+  client.setOptions(opt);
+
+  char path[64];
+  snprintf(path, sizeof(path), "/b?n=%zu&c=%zu", w.bodyBytes, w.chunkBytes);
+
+  std::vector<uint64_t> total, ttfb;
+  uint64_t polls = 0, bodyBytes = 0, errors = 0;
+  uint64_t t0 = nowUs();
+  uint64_t deadline = t0 + (uint64_t)budgetMs * 1000;
+  while (total.size() < 3 || nowUs() < deadline) {
+    client.firstByteUs = 0;
+    client.bodyBytes = 0;
+    uint64_t start = nowUs();
+    if (!client.beginGet("localhost", server.port, path)) {
+      errors++;
+      break;
+    }
+    while (!client.done() && !client.error()) {
+      client.poll();
+      polls++;
+    }
+    uint64_t end = nowUs();
+    if (client.error() || client.bodyBytes != w.bodyBytes) {
+      fprintf(stderr, "%s: %s\n", w.name, client.errorMsg().c_str());
+      if (++errors > 10) break;
+      continue;
+    }
+    total.push_back(end - start);
+    ttfb.push_back(client.firstByteUs ? client.firstByteUs - start : end - start);
+    bodyBytes += client.bodyBytes;
+  }
+  double secs = (double)(nowUs() - t0) / 1e6;
+  size_t n = total.size();
+
+  printf("{\"workload\":\"%s\",\"body_bytes\":%zu,\"chunk_bytes\":%zu,\"keep_alive\":%s,"
+         "\"requests\":%zu,\"errors\":%llu,\"rps\":%.1f,"
+         "\"total_us_p50\":%llu,\"total_us_p99\":%llu,\"ttfb_us_p50\":%llu,\"ttfb_us_p99\":%llu,"
+         "\"body_mb_s\":%.2f,\"polls_per_request\":%.1f}\n",
+         w.name, w.bodyBytes, w.chunkBytes, w.keepAlive ? "true" : "false", n,
+         (unsigned long long)errors, n / secs,
+         (unsigned long long)percentile(total, 0.50), (unsigned long long)percentile(total, 0.99),
+         (unsigned long long)percentile(ttfb, 0.50), (unsigned long long)percentile(ttfb, 0.99),
+         bodyBytes / secs / 1e6, n ? (double)polls / n : 0.0);
+  fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32_t budgetMs = 1000;
+  const char* filter = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "-t")) budgetMs = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-w")) filter = argv[i + 1];
+  }
+
+  LoopbackServer server;
+  if (!server.start()) {
+    fprintf(stderr, "cannot listen on 127.0.0.1\n");
+    return 1;
+  }
+  for (const Workload& w : kWorkloads) {
+    if (filter && !strstr(w.name, filter)) continue;
+    runWorkload(w, server, budgetMs);
+  }
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,474 @@
+// Profiling harness over MockTransport: replays responses under scripted
+// fragmentation, latency, stalls, short writes and resets, on a manual
+// clock (one millisecond per poll()), and reports per request the poll()
+// calls, simulated time (mean, and p50/p99 from AsyncHttpsStats), CPU time
+// and heap allocations as JSON lines.
+//
+//   g++ -std=c++17 -O2 -g -I. -Iextras/host extras/bench/faults.cpp -o ahc-faults
+//   ./ahc-faults [-n requests] [-s scenario-substring] [-r recorded-response-file] [-b 1]
+//
+// -r replays a raw HTTP response (status line to end of body) in every
+// scenario instead of the built-in ones.
+//
+// The headers/ scenarios are a parser microbenchmark instead: the same
+// header bytes go through stepReadHeaders() ("<scenario>/in-place") and
+// through a copy of the header loop this library started with, one read()
+// and one String append per byte and a String per line
+// ("<scenario>/baseline"). Each line reports header MB/s, ns and heap
+// allocations per response, for the header stage alone.
+//
+// -b 1 compares the body path: the caller takes each body with takeBody(),
+// so every request starts from an empty String, and every scenario runs a
+// second time as "<scenario>/string-append" through the onBodyChunk() this
+// library started with (reserve to the new length, then one append per byte).
+#include "AsyncHttpsClient.h"
+#include "MockTransport.h"
+
+#include <time.h>
+
+#include <new>
+#include <string>
+
+namespace {
+
+uint64_t gAllocs = 0;
+uint64_t gAllocBytes = 0;
+
+uint64_t cpuUs() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+String contentLengthReply(size_t n) {
+  String r("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ");
+  r += (unsigned long)n;
+  r += "\r\n\r\n";
+  std::string body(n, 'x');
+  r += body.c_str();
+  return r;
+}
+
+String chunkedReply(size_t n, size_t chunk) {
+  String r("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n");
+  std::string part(chunk, 'x');
+  char size[24];
+  for (size_t left = n; left > 0;) {
+    size_t k = min(left, chunk);
+    snprintf(size, sizeof(size), "%zx\r\n", k);
+    r += size;
+    r.concat(part.c_str(), (unsigned)k);
+    r += "\r\n";
+    left -= k;
+  }
+  r += "0\r\n\r\n";
+  return r;
+}
+
+// A CDN-style response: ~2 KB of headers in front of a small body.
+String headerHeavyReply() {
+  String r("HTTP/1.1 200 OK\r\n");
+  static const char* const kHeaders[] = {
+      "Date: Tue, 14 Nov 2023 22:13:20 GMT",
+      "Content-Type: application/json; charset=utf-8",
+      "Cache-Control: private, no-cache, no-store, must-revalidate, max-age=0",
+      "Pragma: no-cache",
+      "Expires: Thu, 01 Jan 1970 00:00:00 GMT",
+      "Vary: Accept-Encoding, Origin, Authorization",
+      "Strict-Transport-Security: max-age=63072000; includeSubDomains; preload",
+      "Content-Security-Policy: default-src 'self'; script-src 'self' 'unsafe-inline' "
+      "https://cdn.example.net; style-src 'self' 'unsafe-inline'; img-src * data:; "
+      "connect-src 'self' https://api.example.net wss://push.example.net; frame-ancestors 'none'",
+      "X-Content-Type-Options: nosniff",
+      "X-Frame-Options: DENY",
+      "X-XSS-Protection: 0",
+      "Referrer-Policy: strict-origin-when-cross-origin",
+      "Permissions-Policy: geolocation=(), microphone=(), camera=(), payment=()",
+      "Set-Cookie: session=3f9a8c0d1e2b4a5c6d7e8f90a1b2c3d4e5f60718293a4b5c; Path=/; Secure; HttpOnly; SameSite=Lax",
+      "Set-Cookie: region=eu-west-1; Path=/; Max-Age=86400; Secure",
+      "Set-Cookie: ab=variant-b-2023-11; Path=/; Max-Age=2592000; Secure; SameSite=Lax",
+      "ETag: W/\"5f3c-2b1e9d7a4c8f06b3e5d2a1c9f7e4b8d0\"",
+      "Last-Modified: Tue, 14 Nov 2023 21:58:02 GMT",
+      "Access-Control-Allow-Origin: https://app.example.net",
+      "Access-Control-Allow-Credentials: true",
+      "Access-Control-Expose-Headers: ETag, X-Request-Id, X-RateLimit-Remaining",
+      "X-Request-Id: 8d2f6c1a-4b3e-4f59-9a7d-0c1e2b3a4d5f",
+      "X-Correlation-Id: 1f0e9d8c-7b6a-5f4e-3d2c-1b0a9f8e7d6c",
+      "X-RateLimit-Limit: 1200",
+      "X-RateLimit-Remaining: 1187",
+      "X-RateLimit-Reset: 1700000060",
+      "Server-Timing: cdn-cache;desc=MISS, edge;dur=12, origin;dur=87, db;dur=23",
+      "Via: 1.1 varnish, 1.1 6c3f0e2d9a1b.cloudfront.net (CloudFront)",
+      "X-Cache: Miss from cloudfront",
+      "X-Amz-Cf-Pop: FRA56-P4",
+      "X-Amz-Cf-Id: Hq3Jr8dK2sLm9Pz0Xw7Vb5Nc1Tf6Yg4Ue8Ri2Oa3Sd0Fh7Gj9Kl==",
+      "Alt-Svc: h3=\":443\"; ma=86400",
+      "NEL: {\"report_to\":\"default\",\"max_age\":31536000,\"include_subdomains\":true}",
+      "Report-To: {\"group\":\"default\",\"max_age\":31536000,\"endpoints\":[{\"url\":\"https://r.example.net/nel\"}]}",
+      "Connection: keep-alive",
+      "Keep-Alive: timeout=60, max=1000",
+      "Content-Length: 64",
+  };
+  for (const char* h : kHeaders) {
+    r += h;
+    r += "\r\n";
+  }
+  r += "\r\n";
+  std::string body(64, 'x');
+  r += body.c_str();
+  return r;
+}
+
+// The header loop as this library first shipped it, driven straight over a
+// MockTransport.
+struct BaselineParser {
+  int status = -1;
+  long contentLength = -1;
+  bool chunked = false;
+  bool serverRequestedClose = false;
+  size_t headerBytes = 0;
+  size_t maxHeaderBytes = 4096;
+  String line_;
+
+  // True once the blank line is read; false on error or when out of bytes.
+  bool step(MockTransport& t, bool& failed) {
+    while (t.available()) {
+      uint8_t b;
+      if (t.read(&b, 1) != 1) break;
+
+      headerBytes++;
+      if (headerBytes > maxHeaderBytes) return failed = true, false;
+
+      char ch = char(b);
+      line_ += ch;
+      if (line_.length() > 512) return failed = true, false;
+
+      if (ch == '\n') {
+        String line = line_;
+        line_ = "";
+        line.trim();
+        if (line.length() == 0) return true;
+
+        if (line.startsWith("HTTP/1.1") && line.length() >= 12) {
+          status = line.substring(9, 12).toInt();
+          continue;
+        }
+        if (startsWithNoCase(line, "Content-Length:")) {
+          String v = line.substring(strlen("Content-Length:"));
+          v.trim();
+          contentLength = v.toInt();
+          continue;
+        }
+        if (startsWithNoCase(line, "Transfer-Encoding:")) {
+          if (containsNoCase(line, "chunked")) chunked = true;
+          continue;
+        }
+        if (startsWithNoCase(line, "Connection:")) {
+          if (containsNoCase(line, "close")) serverRequestedClose = true;
+          continue;
+        }
+      }
+    }
+    return false;
+  }
+
+  static bool startsWithNoCase(const String& s, const char* prefix) {
+    size_t n = strlen(prefix);
+    if (s.length() < n) return false;
+    for (size_t i = 0; i < n; i++) {
+      char a = s[i], b = prefix[i];
+      if (a >= 'A' && a <= 'Z') a = char(a - 'A' + 'a');
+      if (b >= 'A' && b <= 'Z') b = char(b - 'A' + 'a');
+      if (a != b) return false;
+    }
+    return true;
+  }
+
+  static bool containsNoCase(const String& s, const char* needle) {
+    String hay = s; hay.toLowerCase();
+    String ned = needle; ned.toLowerCase();
+    return hay.indexOf(ned) >= 0;
+  }
+};
+
+// A client whose onBodyChunk() can be switched to the original per-byte
+// String append.
+class BodyBenchClient : public MockHttpsClient {
+public:
+  bool stringAppend = false;
+  size_t maxBodyBytes = 0;
+  String appended;
+
+protected:
+  bool onBodyChunk(const uint8_t* data, size_t len) override {
+    if (!stringAppend) return MockHttpsClient::onBodyChunk(data, len);
+    if (appended.length() + len > maxBodyBytes) return false;
+    appended.reserve(appended.length() + len);
+    for (size_t i = 0; i < len; i++) appended += char(data[i]);
+    return true;
+  }
+};
+
+struct Scenario {
+  const char* name;
+  String reply;
+  bool post;  // 4 KB POST body instead of a GET
+  void (*faults)(MockTransport::Script&);
+};
+
+// stringAppend: the original body append. takeBody: move every body out
+// once its request is done, as a caller that keeps the responses would.
+void runScenario(const Scenario& sc, uint32_t requests, const String& recorded,
+                 bool stringAppend = false, bool takeBody = false) {
+  MockTransport::Script& script = MockTransport::script();
+  script = MockTransport::Script();
+  script.replies.push_back(recorded.length() ? recorded : sc.reply);
+  if (sc.faults) sc.faults(script);
+
+  HostClock& clock = hostClock();
+  clock.manual = true;
+  clock.nowMs = 1000;
+
+  AsyncHttpsStats stats;
+  BodyBenchClient client;
+  client.stringAppend = stringAppend;
+  client.setStats(&stats);
+  client.setCACert("mock");
+  client.setUnixTime(1700000000);
+  MockHttpsClient::Options opt;
+  opt.keepAlive = true;
+  opt.maxBodyBytes = 64 * 1024;
+  client.setOptions(opt);
+  client.maxBodyBytes = opt.maxBodyBytes;
+
+  String postBody;
+  std::string filler(4096, 'p');
+  postBody = filler.c_str();
+
+  uint64_t polls = 0, ok = 0, errors = 0;
+  uint32_t simMs = 0;
+  String lastError;
+  uint64_t allocs0 = gAllocs, bytes0 = gAllocBytes, cpu0 = cpuUs();
+  for (uint32_t i = 0; i < requests; i++) {
+    uint32_t start = clock.nowMs;
+    bool started = sc.post ? client.beginPost("mock.local", 443, "/ingest", postBody)
+                           : client.beginGet("mock.local", 443, "/data");
+    if (!started) {
+      errors++;
+      lastError = client.errorMsg();
+      continue;
+    }
+    while (!client.done() && !client.error()) {
+      client.poll();
+      polls++;
+      clock.nowMs++;
+    }
+    simMs += clock.nowMs - start;
+    if (client.done() && client.status() == 200) {
+      ok++;
+    } else {
+      errors++;
+      lastError = client.errorMsg();
+    }
+    if (stringAppend && takeBody) {
+      String taken(std::move(client.appended));
+    } else if (stringAppend) {
+      client.appended = "";  // keeps the capacity, as reset() did
+    } else if (takeBody) {
+      String taken = client.takeBody();
+    }
+  }
+  uint64_t cpu = cpuUs() - cpu0;
+  uint64_t allocs = gAllocs - allocs0, bytes = gAllocBytes - bytes0;
+  clock.manual = false;
+
+  double n = requests ? (double)requests : 1.0;
+  const AsyncHttpsStats::HostStats* host = stats.find("mock.local");
+  uint32_t p50 = host ? host->totalMs.percentile(0.5f) : 0;
+  uint32_t p99 = host ? host->totalMs.percentile(0.99f) : 0;
+  printf("{\"scenario\":\"%s%s\",\"requests\":%u,\"ok\":%llu,\"errors\":%llu,\"last_error\":\"%s\","
+         "\"connects\":%u,\"polls_per_request\":%.1f,\"sim_ms_per_request\":%.1f,"
+         "\"sim_ms_p50\":%u,\"sim_ms_p99\":%u,"
+         "\"cpu_us_per_request\":%.2f,\"allocs_per_request\":%.2f,\"alloc_bytes_per_request\":%.0f}\n",
+         sc.name, stringAppend ? "/string-append" : "", requests, (unsigned long long)ok,
+         (unsigned long long)errors, lastError.c_str(),
+         script.connects, polls / n, simMs / n, p50, p99, cpu / n, allocs / n, bytes / n);
+  fflush(stdout);
+}
+
+uint64_t monoNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void printParser(const Scenario& sc, const char* parser, uint32_t requests, uint64_t ok,
+                 size_t headerBytes, uint64_t ns, uint64_t allocs) {
+  double n = requests ? (double)requests : 1.0;
+  double mbS = ns ? (double)headerBytes * ok * 1000.0 / (double)ns : 0.0;
+  printf("{\"scenario\":\"%s/%s\",\"requests\":%u,\"ok\":%llu,\"header_bytes\":%zu,"
+         "\"header_mb_s\":%.1f,\"ns_per_response\":%.0f,\"allocs_per_response\":%.2f}\n",
+         sc.name, parser, requests, (unsigned long long)ok, headerBytes, mbS, ns / n, allocs / n);
+  fflush(stdout);
+}
+
+// The headers/ scenarios: the same header bytes, under the same read()
+// fragmentation, through stepReadHeaders() and through BaselineParser. Only
+// the header stage is on the clock: for the client, the poll() calls made
+// in READ_HEADERS (body kept off); for the baseline, its loop up to the blank
+// line.
+void runHeaderParsers(const Scenario& sc, uint32_t requests, const String& recorded) {
+  const String& response = recorded.length() ? recorded : sc.reply;
+  int end = response.indexOf(String("\r\n\r\n"));
+  size_t headerBytes = end < 0 ? response.length() : (size_t)end + 4;
+  HostClock& clock = hostClock();
+  MockTransport::Script& script = MockTransport::script();
+
+  {
+    script = MockTransport::Script();
+    script.replies.push_back(response);
+    if (sc.faults) sc.faults(script);
+    clock.manual = true;
+    clock.nowMs = 1000;
+    MockHttpsClient client;
+    client.setCACert("mock");
+    client.setUnixTime(1700000000);
+    MockHttpsClient::Options opt;
+    opt.keepAlive = true;
+    opt.keepBody = false;
+    client.setOptions(opt);
+
+    uint64_t ok = 0, ns = 0, allocs = 0;
+    for (uint32_t i = 0; i < requests; i++) {
+      if (!client.beginGet("mock.local", 443, "/data")) continue;
+      while (!client.done() && !client.error()) {
+        bool headers = client.state() == MockHttpsClient::READ_HEADERS;
+        uint64_t a0 = gAllocs, t0 = headers ? monoNs() : 0;
+        client.poll();
+        if (headers) {
+          ns += monoNs() - t0;
+          allocs += gAllocs - a0;
+        }
+        clock.nowMs++;
+      }
+      if (client.done() && client.status() == 200) ok++;
+    }
+    printParser(sc, "in-place", requests, ok, headerBytes, ns, allocs);
+  }
+
+  {
+    script = MockTransport::Script();
+    script.replies.push_back(response);
+    if (sc.faults) sc.faults(script);
+    clock.nowMs = 1000;
+    static const char kRequest[] = "GET /data HTTP/1.1\r\nHost: mock.local\r\nConnection: keep-alive\r\n\r\n";
+    MockTransport t;
+    AhcTlsParams params{};
+    params.connectTimeoutMs = params.handshakeTimeoutMs = 1000;
+    uint64_t ok = 0, ns = 0, allocs = 0;
+    for (uint32_t i = 0; i < requests; i++) {
+      if (!t.connected() && t.connect(params, nullptr) != AhcConnect::DONE) continue;
+      t.write((const uint8_t*)kRequest, sizeof(kRequest) - 1);
+      BaselineParser p;
+      bool failed = false, done = false;
+      uint64_t a0 = gAllocs, t0 = monoNs();
+      while (!failed && !(done = p.step(t, failed)) && t.connected()) clock.nowMs++;
+      ns += monoNs() - t0;
+      allocs += gAllocs - a0;
+      uint8_t drain[768];
+      for (long left = p.contentLength; done && left > 0 && t.connected();) {
+        int n = t.read(drain, (size_t)min<long>(left, sizeof(drain)));
+        left -= n;
+        if (n == 0) clock.nowMs++;
+      }
+      if (done && p.status == 200) ok++;
+    }
+    printParser(sc, "baseline", requests, ok, headerBytes, ns, allocs);
+  }
+  clock.manual = false;
+}
+
+bool loadFile(const char* path, String& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.concat(buf, (unsigned)n);
+  fclose(f);
+  return true;
+}
+
+}  // namespace
+
+// Count every heap allocation made while a scenario runs.
+void* operator new(size_t n) {
+  gAllocs++;
+  gAllocBytes += n;
+  if (void* p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+  gAllocs++;
+  gAllocBytes += n;
+  return malloc(n ? n : 1);
+}
+void* operator new[](size_t n, const std::nothrow_t& t) noexcept { return operator new(n, t); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+int main(int argc, char** argv) {
+  uint32_t requests = 200;
+  const char* filter = nullptr;
+  String recorded;
+  bool bodyCompare = false;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "-n")) {
+      requests = (uint32_t)atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "-b")) {
+      bodyCompare = atoi(argv[i + 1]) != 0;
+    } else if (!strcmp(argv[i], "-s")) {
+      filter = argv[i + 1];
+    } else if (!strcmp(argv[i], "-r") && !loadFile(argv[i + 1], recorded)) {
+      fprintf(stderr, "cannot read %s\n", argv[i + 1]);
+      return 1;
+    }
+  }
+
+  const String cl16k = contentLengthReply(16 * 1024);
+  const String chunked16k = chunkedReply(16 * 1024, 256);
+  const String heavy = headerHeavyReply();
+  const Scenario scenarios[] = {
+      {"headers/heavy", heavy, false, nullptr},
+      {"headers/heavy-1-byte-reads", heavy, false,
+       [](MockTransport::Script& s) { s.readChunk = 1; }},
+      {"content-length/burst", cl16k, false, nullptr},
+      {"content-length/1-byte-reads", cl16k, false,
+       [](MockTransport::Script& s) { s.readChunk = 1; }},
+      {"content-length/random-1..536", cl16k, false,
+       [](MockTransport::Script& s) { s.readChunk = 536; s.seed = 1; }},
+      {"chunked/burst", chunked16k, false, nullptr},
+      {"chunked/1-byte-reads", chunked16k, false,
+       [](MockTransport::Script& s) { s.readChunk = 1; }},
+      {"chunked/random-1..536", chunked16k, false,
+       [](MockTransport::Script& s) { s.readChunk = 536; s.seed = 1; }},
+      {"latency-40ms/stall-20ms-per-4k", cl16k, false,
+       [](MockTransport::Script& s) { s.latencyMs = 40; s.stallEveryBytes = 4096; s.stallMs = 20; }},
+      {"post-4k/short-writes", contentLengthReply(16), true,
+       [](MockTransport::Script& s) { s.writeChunk = 61; s.writeStallEvery = 3; }},
+      {"reset-mid-body", cl16k, false,
+       [](MockTransport::Script& s) { s.resetAfterBytes = 8000; s.readChunk = 1460; }},
+  };
+  for (const Scenario& sc : scenarios) {
+    if (filter && !strstr(sc.name, filter)) continue;
+    if (!strncmp(sc.name, "headers/", 8)) {
+      runHeaderParsers(sc, requests, recorded);
+      continue;
+    }
+    runScenario(sc, requests, recorded, false, bodyCompare);
+    if (bodyCompare) runScenario(sc, requests, recorded, true, true);
+  }
+  return 0;
+}
@@ -0,0 +1,187 @@
+#pragma once
+// Minimal Arduino core for building AsyncHttpsClient.h on a workstation:
+// String, millis()/delay(), PROGMEM helpers, IPAddress, Serial and ESP.
+// Only what the library touches; put this directory on the include path
+// ahead of any real core.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+
+using std::max;
+using std::min;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) (s)
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+// Real time by default. Set manual to drive millis() by hand (delay()
+// then advances it), which makes runs against MockTransport repeatable.
+struct HostClock {
+  bool manual = false;
+  uint32_t nowMs = 0;
+};
+
+inline HostClock& hostClock() {
+  static HostClock clock;
+  return clock;
+}
+
+inline uint32_t millis() {
+  using namespace std::chrono;
+  static const steady_clock::time_point t0 = steady_clock::now();
+  if (hostClock().manual) return hostClock().nowMs;
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now() - t0).count();
+}
+
+inline void delay(unsigned long ms) {
+  if (hostClock().manual) hostClock().nowMs += (uint32_t)ms;
+  else if (ms) std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield() {}
+
+// Arduino String over std::string. Moved-from strings are empty, as on the
+// cores, so code that relies on that behaves the same here.
+class String {
+public:
+  String() = default;
+  String(const char* s) : _s(s ? s : "") {}
+  String(const String&) = default;
+  String(String&& o) noexcept : _s(std::move(o._s)) { o._s.clear(); }
+  explicit String(char c) : _s(1, c) {}
+  explicit String(int v) : _s(std::to_string(v)) {}
+  explicit String(unsigned v) : _s(std::to_string(v)) {}
+  explicit String(long v) : _s(std::to_string(v)) {}
+  explicit String(unsigned long v) : _s(std::to_string(v)) {}
+
+  String& operator=(const String&) = default;
+  String& operator=(String&& o) noexcept {
+    _s = std::move(o._s);
+    o._s.clear();
+    return *this;
+  }
+  String& operator=(const char* s) {
+    _s = s ? s : "";
+    return *this;
+  }
+
+  unsigned int length() const { return (unsigned)_s.size(); }
+  const char* c_str() const { return _s.c_str(); }
+  bool reserve(unsigned int n) {
+    _s.reserve(n);
+    return true;
+  }
+
+  bool concat(const char* s, unsigned int n) {
+    _s.append(s, n);
+    return true;
+  }
+  bool concat(const String& s) {
+    _s += s._s;
+    return true;
+  }
+  String& operator+=(const String& s) { _s += s._s; return *this; }
+  String& operator+=(const char* s) { _s += s; return *this; }
+  String& operator+=(char c) { _s += c; return *this; }
+  String& operator+=(int v) { _s += std::to_string(v); return *this; }
+  String& operator+=(unsigned v) { _s += std::to_string(v); return *this; }
+  String& operator+=(long v) { _s += std::to_string(v); return *this; }
+  String& operator+=(unsigned long v) { _s += std::to_string(v); return *this; }
+
+  char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+  bool operator==(const String& o) const { return _s == o._s; }
+  bool operator==(const char* s) const { return _s == (s ? s : ""); }
+  bool operator!=(const String& o) const { return _s != o._s; }
+  bool operator!=(const char* s) const { return !(*this == s); }
+
+  bool startsWith(const String& p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+  bool endsWith(const String& p) const {
+    return _s.size() >= p._s.size() &&
+           _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+  }
+  int indexOf(char c) const { return find(_s.find(c)); }
+  int indexOf(const String& s) const { return find(_s.find(s._s)); }
+  String substring(unsigned int from) const { return substring(from, length()); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > _s.size()) from = (unsigned)_s.size();
+    if (to < from) to = from;
+    return String(_s.substr(from, to - from).c_str());
+  }
+  void remove(unsigned int index) {
+    if (index < _s.size()) _s.erase(index);
+  }
+  void remove(unsigned int index, unsigned int count) {
+    if (index < _s.size()) _s.erase(index, count);
+  }
+  long toInt() const { return atol(_s.c_str()); }
+  void toLowerCase() {
+    for (auto& c : _s) c = (char)tolower((unsigned char)c);
+  }
+  void trim() {
+    size_t a = _s.find_first_not_of(" \t\r\n");
+    size_t b = _s.find_last_not_of(" \t\r\n");
+    _s = (a == std::string::npos) ? std::string() : _s.substr(a, b - a + 1);
+  }
+
+  friend String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+
+private:
+  static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+  std::string _s;
+};
+
+// IPv4 address held in network byte order, like the cores.
+class IPAddress {
+public:
+  IPAddress() = default;
+  IPAddress(uint32_t addr) : _addr(addr) {}
+  operator uint32_t() const { return _addr; }
+  bool fromString(const char* s) {
+    unsigned a, b, c, d;
+    char tail;
+    if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) return false;
+    if (a > 255 || b > 255 || c > 255 || d > 255) return false;
+    _addr = a | b << 8 | c << 16 | d << 24;
+    return true;
+  }
+  bool fromString(const String& s) { return fromString(s.c_str()); }
+
+private:
+  uint32_t _addr = 0;
+};
+
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  template <class... Args>
+  void printf(const char* fmt, Args... args) { ::printf(fmt, args...); }
+  void print(const char* s) { fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void println(const char* s = "") { puts(s); }
+  void println(const String& s) { println(s.c_str()); }
+};
+
+// The heap is not the constraint here: AsyncHttpsPool::Options::minFreeHeap
+// only triggers when a test lowers freeHeap.
+class HostEsp {
+public:
+  uint32_t freeHeap = UINT32_MAX;
+  uint32_t getFreeHeap() const { return freeHeap; }
+};
+
+inline HostSerial Serial;
+inline HostEsp ESP;
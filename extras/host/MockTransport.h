@@ -0,0 +1,262 @@
+#pragma once
+// In-memory transport: drives BasicAsyncHttpsClient through complete
+// request/response cycles without a network, for tests, benchmarks and
+// profiling of the parser.
+//
+//   MockTransport::script().respond = [](const String& request) {
+//     return String("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+//   };
+//   MockHttpsClient client;
+//
+// Every instance shares the script. Each request head (plus its
+// Content-Length or chunked body) written by the client is answered by
+// respond(), or by the recorded replies in turn, and the answer is queued
+// for reading.
+//
+// The fault knobs reshape delivery the way a real socket would: slow
+// connects and handshakes, fragments, latency, stalls, short writes and
+// resets. Times are millis(), so with hostClock().manual set a run is fully
+// repeatable.
+#include <Arduino.h>
+#include "../../AsyncHttpsClient.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class MockTransport {
+public:
+  struct Session {
+    uint32_t id;
+  };
+  static const bool kResumesSessions = true;
+  static const bool kConnectByIp = true;
+  static const bool kOneSocketTimeout = false;
+
+  struct Script {
+    std::function<String(const String& request)> respond;
+    std::vector<String> replies;   // used when respond is not set
+
+    // Connection
+    bool failConnect = false;       // refuse, once tcpMs has passed
+    uint8_t connectPolls = 0;       // PENDING results before connect() is done
+    uint32_t tcpMs = 0;             // TCP connect takes this long...
+    uint32_t tlsMs = 0;             // ...then the handshake this long
+    bool closeAfterResponse = false;
+
+    // Faults
+    size_t readChunk = 0;           // max bytes per read() (0 = no limit)
+    uint32_t seed = 0;              // nonzero: each read() takes 1..readChunk bytes at random
+    uint32_t latencyMs = 0;         // request complete -> first reply byte readable
+    size_t stallEveryBytes = 0;     // pause delivery after every this many reply bytes...
+    uint32_t stallMs = 0;           // ...for this long
+    size_t writeChunk = 0;          // max bytes per write() (0 = no limit)
+    uint8_t writeStallEvery = 0;    // every Nth write() accepts nothing (0 = never)
+    int writeRoom = -1;             // availableForWrite() result (-1 = unknown)
+    size_t resetAfterBytes = 0;     // drop the connection after this many reply bytes (0 = never)
+    uint8_t dropRequests = 0;       // swallow this many requests and close without a reply
+
+    // Counters
+    uint32_t connects = 0;
+    uint32_t resumed = 0;
+    uint32_t requests = 0;
+    uint32_t resets = 0;
+  };
+
+  static Script& script() {
+    static Script s;
+    return s;
+  }
+
+  AhcConnect connect(const AhcTlsParams& p, Session* session) {
+    Script& sc = script();
+    uint32_t now = millis();
+    if (!_connecting) {
+      _connecting = true;
+      _connT0 = now;
+    }
+    // Time out against the client's budgets the way a real socket would.
+    uint32_t took = now - _connT0;
+    if (took < sc.tcpMs) {
+      if (took >= p.connectTimeoutMs) return endConnect(AhcConnect::TCP_TIMEOUT);
+      return AhcConnect::PENDING;
+    }
+    if (sc.failConnect) return endConnect(AhcConnect::FAILED);
+    if (took < sc.tcpMs + sc.tlsMs) {
+      if (took - sc.tcpMs >= p.handshakeTimeoutMs) return endConnect(AhcConnect::TLS_TIMEOUT);
+      return AhcConnect::PENDING;
+    }
+    if (_pendingPolls < sc.connectPolls) {
+      _pendingPolls++;
+      return AhcConnect::PENDING;
+    }
+    _pendingPolls = 0;
+    _connecting = false;
+    sc.connects++;
+    _resumed = session && session->id != 0;
+    if (_resumed) sc.resumed++;
+    if (session && !_resumed) session->id = sc.connects;
+    _open = true;
+    _sent.clear();
+    _inbox.clear();
+    _inPos = 0;
+    _delivered = 0;
+    _writes = 0;
+    _readyAt = millis();
+    _rng = sc.seed + sc.connects;
+    return AhcConnect::DONE;
+  }
+
+  bool sessionResumed() const { return _resumed; }
+  uint16_t tcpConnectMs() const { return (uint16_t)min<uint32_t>(script().tcpMs, 0xFFFF); }
+  bool saveSession(Session&) { return false; }
+
+  uint8_t connected() { return _open || _inPos < _inbox.size(); }
+
+  int available() {
+    if ((int32_t)(millis() - _readyAt) < 0) return 0;
+    return (int)(_inbox.size() - _inPos);
+  }
+
+  int read(uint8_t* dst, size_t len) {
+    Script& sc = script();
+    size_t n = min(len, (size_t)max(available(), 0));
+    if (sc.readChunk) {
+      size_t cap = sc.seed ? 1 + nextRandom() % sc.readChunk : sc.readChunk;
+      n = min(n, cap);
+    }
+    if (sc.stallEveryBytes) {
+      n = min(n, sc.stallEveryBytes - _delivered % sc.stallEveryBytes);
+    }
+    if (sc.resetAfterBytes) n = min(n, sc.resetAfterBytes - _delivered);
+    memcpy(dst, _inbox.data() + _inPos, n);
+    _inPos += n;
+    _delivered += n;
+
+    if (sc.resetAfterBytes && _delivered >= sc.resetAfterBytes) {
+      sc.resets++;
+      stop();
+      return (int)n;
+    }
+    if (sc.stallEveryBytes && n && _delivered % sc.stallEveryBytes == 0) {
+      _readyAt = millis() + sc.stallMs;
+    }
+    if (_inPos == _inbox.size()) {
+      _inbox.clear();  // keeps the capacity for the next reply
+      _inPos = 0;
+    }
+    return (int)n;
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    Script& sc = script();
+    if (!_open) return 0;
+    if (sc.writeStallEvery && ++_writes % sc.writeStallEvery == 0) return 0;
+    if (sc.writeChunk) len = min(len, sc.writeChunk);
+    _sent.append((const char*)data, len);
+    while (answerOne()) {}
+    return len;
+  }
+
+  int availableForWrite() { return script().writeRoom; }
+
+  void stop() {
+    _connecting = false;
+    _open = false;
+    _inbox.clear();
+    _inPos = 0;
+    _sent.clear();
+  }
+
+  int lastError(char* buf, size_t len) {
+    if (len) buf[0] = 0;
+    return script().failConnect ? -1 : 0;
+  }
+
+private:
+  AhcConnect endConnect(AhcConnect r) {
+    _connecting = false;
+    return r;
+  }
+
+  // Hand the oldest complete request in _sent to the script.
+  // Kept allocation-free on the replay path so it does not skew profiles.
+  bool answerOne() {
+    size_t end = _sent.find("\r\n\r\n");
+    if (end == std::string::npos) return false;
+    size_t total = end + 4;
+    size_t te = _sent.find("Transfer-Encoding: chunked\r\n");
+    size_t cl = _sent.find("Content-Length: ");
+    if (te < end) {
+      total = chunkedEnd(total);
+      if (total == std::string::npos) return false;
+    } else if (cl < end) {
+      total += (size_t)atol(_sent.c_str() + cl + 16);
+    }
+    if (_sent.size() < total) return false;
+
+    Script& sc = script();
+    if (sc.dropRequests) {
+      // A server that already timed out the idle connection.
+      sc.dropRequests--;
+      _sent.erase(0, total);
+      _open = false;
+      return false;
+    }
+    if (_inPos == _inbox.size()) _readyAt = millis() + sc.latencyMs;
+    if (sc.respond) {
+      String reply = sc.respond(String(_sent.substr(0, total).c_str()));
+      _inbox.append(reply.c_str(), reply.length());
+    } else if (!sc.replies.empty()) {
+      const String& reply = sc.replies[sc.requests % sc.replies.size()];
+      _inbox.append(reply.c_str(), reply.length());
+    }
+    _sent.erase(0, total);
+    sc.requests++;
+    if (sc.closeAfterResponse) _open = false;
+    return true;
+  }
+
+  // End of a chunked body starting at pos (after the last chunk and the
+  // trailer section), or npos while it is incomplete.
+  size_t chunkedEnd(size_t pos) const {
+    for (;;) {
+      size_t eol = _sent.find("\r\n", pos);
+      if (eol == std::string::npos) return std::string::npos;
+      size_t size = strtoul(_sent.c_str() + pos, nullptr, 16);
+      if (size == 0) {
+        if (_sent.compare(eol + 2, 2, "\r\n") == 0) return eol + 4;
+        size_t t = _sent.find("\r\n\r\n", eol);
+        return t == std::string::npos ? t : t + 4;
+      }
+      pos = eol + 2 + size + 2;
+      if (pos > _sent.size()) return std::string::npos;
+    }
+  }
+
+  // xorshift32: the same seed gives the same fragment sizes on every run.
+  uint32_t nextRandom() {
+    if (_rng == 0) _rng = 1;
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+  }
+
+  std::string _sent;
+  std::string _inbox;
+  size_t _inPos = 0;
+  size_t _delivered = 0;   // reply bytes read on this connection
+  uint32_t _readyAt = 0;   // millis() before which nothing is readable
+  uint32_t _writes = 0;
+  uint32_t _rng = 0;
+  bool _open = false;
+  bool _resumed = false;
+  uint8_t _pendingPolls = 0;
+  bool _connecting = false;
+  uint32_t _connT0 = 0;    // millis() of the first connect() call of this attempt
+};
+
+using MockHttpsPool = BasicAsyncHttpsPool<MockTransport>;
+using MockHttpsClient = BasicAsyncHttpsClient<MockTransport>;
+using MockHttpsScheduler = BasicAsyncHttpsScheduler<MockTransport>;
@@ -0,0 +1,345 @@
+#pragma once
+// Non-blocking TCP + OpenSSL transport for running BasicAsyncHttpsClient on
+// Linux/macOS. Build with -Iextras/host and link -lssl -lcrypto:
+//
+//   #include "AsyncHttpsClient.h"
+//   #include "PosixTlsTransport.h"
+//   HostHttpsClient client;   // BasicAsyncHttpsClient<PosixTlsTransport>
+//
+// Name lookup (getaddrinfo) blocks; connect and handshake do not. The
+// certificate is checked against the CA given to setCACert() and the host
+// name, at the client's clock (setUnixTime()).
+#include <Arduino.h>
+#include "../../AsyncHttpsClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+class PosixTlsTransport {
+public:
+  // DER-encoded SSL_SESSION (it carries the server certificate).
+  struct Session {
+    uint16_t len;
+    uint8_t der[4096];
+  };
+  static const bool kResumesSessions = true;
+  static const bool kConnectByIp = true;
+  static const bool kOneSocketTimeout = false;
+
+  PosixTlsTransport() {
+    // A write to a socket the peer closed must fail, not kill the process.
+    static bool sigpipeIgnored = (signal(SIGPIPE, SIG_IGN), true);
+    (void)sigpipeIgnored;
+  }
+  ~PosixTlsTransport() {
+    stop();
+    if (_ctx) SSL_CTX_free(_ctx);
+  }
+  PosixTlsTransport(const PosixTlsTransport&) = delete;
+  PosixTlsTransport& operator=(const PosixTlsTransport&) = delete;
+
+  AhcConnect connect(const AhcTlsParams& p, Session* session) {
+    if (_phase == IDLE && !startTcp(p)) return failConnect();
+    uint32_t now = millis();
+
+    if (_phase == TCP) {
+      pollfd pfd = {_fd, POLLOUT, 0};
+      if (::poll(&pfd, 1, 0) == 0) {
+        if (now - _t0 >= p.connectTimeoutMs) return failConnect("connect timeout", AhcConnect::TCP_TIMEOUT);
+        return AhcConnect::PENDING;
+      }
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err) return failConnect(strerror(err));
+      _tcpMs = (uint16_t)min<uint32_t>(now - _t0, 0xFFFF);
+      if (!startTls(p, session)) return failConnect();
+      _phase = TLS;
+      _t0 = now;
+    }
+
+    if (_phase == TLS) {
+      ERR_clear_error();
+      int r = SSL_connect(_ssl);
+      if (r != 1) {
+        int e = SSL_get_error(_ssl, r);
+        if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+          if (now - _t0 >= p.handshakeTimeoutMs) return failConnect("handshake timeout", AhcConnect::TLS_TIMEOUT);
+          return AhcConnect::PENDING;
+        }
+        return failConnect();
+      }
+      _phase = OPEN;
+      _resumed = SSL_session_reused(_ssl) == 1;
+      captureSession();
+    }
+    return AhcConnect::DONE;
+  }
+
+  bool sessionResumed() const { return _resumed; }
+  uint16_t tcpConnectMs() const { return _tcpMs; }
+
+  // TLS 1.3 servers send their ticket after the handshake; it is picked up
+  // by the reads that follow.
+  bool saveSession(Session& out) {
+    if (!_haveSession) return false;
+    out.len = _session.len;
+    memcpy(out.der, _session.der, _session.len);
+    return true;
+  }
+
+  uint8_t connected() {
+    available();  // notices a close the peer already sent
+    return (_phase == OPEN && !_eof) || _rxPos < _rxLen;
+  }
+
+  int available() {
+    if (_rxPos == _rxLen && _phase == OPEN && !_eof) {
+      _rxPos = _rxLen = 0;
+      ERR_clear_error();
+      int r = SSL_read(_ssl, _rx, sizeof(_rx));
+      if (r > 0) {
+        _rxLen = (size_t)r;
+        captureSession();
+      } else {
+        int e = SSL_get_error(_ssl, r);
+        if (e != SSL_ERROR_WANT_READ && e != SSL_ERROR_WANT_WRITE) {
+          if (e != SSL_ERROR_ZERO_RETURN) setError();
+          _eof = true;
+        }
+      }
+    }
+    return (int)(_rxLen - _rxPos);
+  }
+
+  int read(uint8_t* dst, size_t len) {
+    if (available() <= 0) return 0;
+    size_t n = min(len, _rxLen - _rxPos);
+    memcpy(dst, _rx + _rxPos, n);
+    _rxPos += n;
+    return (int)n;
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    if (_phase != OPEN || _eof || len == 0) return 0;
+    ERR_clear_error();
+    int r = SSL_write(_ssl, data, (int)min(len, (size_t)INT32_MAX));
+    if (r > 0) return (size_t)r;
+    int e = SSL_get_error(_ssl, r);
+    if (e != SSL_ERROR_WANT_READ && e != SSL_ERROR_WANT_WRITE) {
+      setError();
+      _eof = true;
+    }
+    return 0;
+  }
+
+  int availableForWrite() { return -1; }
+
+  void stop() {
+    if (_ssl) {
+      if (_phase == OPEN && !_eof) SSL_shutdown(_ssl);  // best effort, non-blocking
+      SSL_free(_ssl);
+      _ssl = nullptr;
+    }
+    if (_fd >= 0) {
+      ::close(_fd);
+      _fd = -1;
+    }
+    _phase = IDLE;
+    _eof = false;
+    _haveSession = false;
+    _rxPos = _rxLen = 0;
+  }
+
+  int lastError(char* buf, size_t len) {
+    if (len) snprintf(buf, len, "%s", _err.c_str());
+    return _errCode;
+  }
+
+private:
+  enum Phase : uint8_t { IDLE, TCP, TLS, OPEN };
+
+  bool startTcp(const AhcTlsParams& p) {
+    _errCode = 0;
+    _err = "";
+    _resumed = false;
+    _tcpMs = 0;
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(p.port);
+    if (p.ip) {
+      sa.sin_addr.s_addr = p.ip;
+    } else {
+      addrinfo hints;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      addrinfo* res = nullptr;
+      int rc = getaddrinfo(p.host, nullptr, &hints, &res);
+      if (rc != 0 || !res) {
+        setError(gai_strerror(rc));
+        return false;
+      }
+      sa.sin_addr = ((sockaddr_in*)res->ai_addr)->sin_addr;
+      freeaddrinfo(res);
+    }
+
+    _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (_fd < 0) {
+      setError(strerror(errno));
+      return false;
+    }
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(_fd, (sockaddr*)&sa, sizeof(sa)) != 0 && errno != EINPROGRESS) {
+      setError(strerror(errno));
+      return false;
+    }
+    _phase = TCP;
+    _t0 = millis();
+    return true;
+  }
+
+  bool startTls(const AhcTlsParams& p, const Session* session) {
+    if (!_ctx || _ctxPem != p.caPem) {
+      if (_ctx) SSL_CTX_free(_ctx);
+      _ctx = newContext(p.caPem);
+      _ctxPem = p.caPem;
+      if (!_ctx) {
+        setError("no usable CA certificate");
+        return false;
+      }
+    }
+    _ssl = SSL_new(_ctx);
+    if (!_ssl) {
+      setError();
+      return false;
+    }
+    SSL_set_fd(_ssl, _fd);
+    // An IP literal is checked against the certificate's IP entries and is
+    // not sent as SNI.
+    X509_VERIFY_PARAM* vp = SSL_get0_param(_ssl);
+    if (IPAddress().fromString(p.host)) {
+      X509_VERIFY_PARAM_set1_ip_asc(vp, p.host);
+    } else {
+      SSL_set_tlsext_host_name(_ssl, p.host);
+      SSL_set1_host(_ssl, p.host);
+    }
+    if (p.now > 0) X509_VERIFY_PARAM_set_time(vp, p.now);
+    if (session && session->len > 0 && session->len <= sizeof(session->der)) {
+      const uint8_t* q = session->der;
+      SSL_SESSION* s = d2i_SSL_SESSION(nullptr, &q, session->len);
+      if (s) {
+        SSL_set_session(_ssl, s);
+        SSL_SESSION_free(s);
+      }
+    }
+    return true;
+  }
+
+  static SSL_CTX* newContext(const char* caPem) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx) return nullptr;
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    if (caPem && caPem[0]) {
+      BIO* bio = BIO_new_mem_buf(caPem, -1);
+      X509_STORE* store = SSL_CTX_get_cert_store(ctx);
+      int added = 0;
+      while (X509* cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+        added += X509_STORE_add_cert(store, cert);
+        X509_free(cert);
+      }
+      BIO_free(bio);
+      ERR_clear_error();  // end of PEM input
+      if (!added) {
+        SSL_CTX_free(ctx);
+        return nullptr;
+      }
+    }
+    return ctx;
+  }
+
+  // Serialize the session once it can be resumed. Done right away because a
+  // server closing without close_notify makes OpenSSL mark it unusable.
+  void captureSession() {
+    if (_haveSession) return;
+    SSL_SESSION* s = SSL_get0_session(_ssl);
+    if (!s || !SSL_SESSION_is_resumable(s)) return;
+    int len = i2d_SSL_SESSION(s, nullptr);
+    if (len <= 0 || len > (int)sizeof(_session.der)) return;
+    uint8_t* p = _session.der;
+    i2d_SSL_SESSION(s, &p);
+    _session.len = (uint16_t)len;
+    _haveSession = true;
+  }
+
+  AhcConnect failConnect(const char* why = nullptr, AhcConnect result = AhcConnect::FAILED) {
+    if (why) setError(why);
+    else if (!_errCode) setError();
+    stop();
+    return result;
+  }
+
+  void setError(const char* why) {
+    _errCode = -1;
+    _err = why;
+  }
+
+  // From the OpenSSL error queue, or the certificate check.
+  void setError() {
+    unsigned long e = ERR_peek_last_error();
+    long v = _ssl ? SSL_get_verify_result(_ssl) : X509_V_OK;
+    char buf[160];
+    if (v != X509_V_OK) {
+      _errCode = (int)v;
+      _err = X509_verify_cert_error_string(v);
+    } else if (e) {
+      _errCode = (int)ERR_GET_REASON(e);
+      ERR_error_string_n(e, buf, sizeof(buf));
+      _err = buf;
+    } else {
+      _errCode = -1;
+      _err = errno ? strerror(errno) : "connection closed";
+    }
+    ERR_clear_error();
+  }
+
+  int _fd = -1;
+  SSL_CTX* _ctx = nullptr;
+  const char* _ctxPem = nullptr;
+  SSL* _ssl = nullptr;
+  Phase _phase = IDLE;
+  bool _eof = false;
+  bool _resumed = false;
+  bool _haveSession = false;
+  uint32_t _t0 = 0;
+  uint16_t _tcpMs = 0;     // socket connected, in ms after startTcp()
+  Session _session;
+
+  // SSL_read() output, so available() can report bytes without losing them.
+  uint8_t _rx[16 * 1024];
+  size_t _rxPos = 0;
+  size_t _rxLen = 0;
+
+  int _errCode = 0;
+  String _err;
+};
+
+using HostHttpsPool = BasicAsyncHttpsPool<PosixTlsTransport>;
+using HostHttpsClient = BasicAsyncHttpsClient<PosixTlsTransport>;
+using HostHttpsScheduler = BasicAsyncHttpsScheduler<PosixTlsTransport>;
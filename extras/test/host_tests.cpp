@@ -0,0 +1,682 @@
+// Behavioral checks of the parser and state machine over MockTransport, on
+// a manual clock. Exits non-zero if any group fails.
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -I. -Iextras/host extras/test/host_tests.cpp -o ahc-tests
+//   ./ahc-tests
+#include "AsyncHttpsClient.h"
+#include "MockTransport.h"
+
+#include <unistd.h>
+
+namespace {
+
+int gFailures = 0;
+const char* gSelf = nullptr;  // argv[0], for the second-process warm state check
+
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      gFailures++;                                                     \
+    }                                                                  \
+  } while (0)
+
+void fresh() {
+  MockTransport::script() = MockTransport::Script();
+  hostClock().manual = true;
+  hostClock().nowMs = 1000;
+}
+
+template <class C>
+void setUp(C& c, bool keepAlive = true) {
+  c.setCACert("mock");
+  c.setUnixTime(1700000000);
+  typename C::Options opt;
+  opt.keepAlive = keepAlive;
+  c.setOptions(opt);
+}
+
+// Poll to done()/error(), one simulated millisecond per poll().
+template <class C>
+void run(C& c) {
+  for (int i = 0; i < 100000 && !c.done() && !c.error(); i++) {
+    c.poll();
+    hostClock().nowMs++;
+  }
+}
+
+void reply(const char* r) { MockTransport::script().replies.push_back(String(r)); }
+
+void chunkedWithTrailers() {
+  for (size_t frag : {0, 1, 3, 7}) {
+    fresh();
+    reply("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "5\r\nhello\r\n1;ext=1\r\n,\r\n6\r\n world\r\n0\r\nX-Trailer: t\r\n\r\n");
+    MockTransport::script().readChunk = frag;
+    MockHttpsClient c;
+    setUp(c);
+    CHECK(c.beginGet("mock.local", 443, "/"));
+    run(c);
+    CHECK(c.done() && c.status() == 200);
+    CHECK(c.body() == "hello, world");
+    // The trailer section was consumed: the socket is reused.
+    CHECK(c.beginGet("mock.local", 443, "/"));
+    run(c);
+    CHECK(c.done() && c.body() == "hello, world");
+    CHECK(MockTransport::script().connects == 1);
+  }
+}
+
+void interimAndBodiless() {
+  fresh();
+  reply("HTTP/1.1 100 Continue\r\nX-Interim: 1\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && c.status() == 200 && c.body() == "ok");
+  CHECK(!c.header("X-Interim"));
+
+  // 204 without a length completes at the end of the headers.
+  fresh();
+  reply("HTTP/1.1 204 No Content\r\nX-A: 1\r\n\r\n");
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && c.status() == 204 && c.bodyLength() == 0);
+
+  // HEAD ignores the advertised length.
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n");
+  c.beginHead("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && c.status() == 200 && c.bodyLength() == 0);
+  CHECK(String(c.header("Content-Length").c_str()) == "1000");
+}
+
+void pipelining() {
+  fresh();
+  MockTransport::script().respond = [](const String& req) {
+    String path = req.substring(4, req.indexOf(String(" HTTP/1.1")));
+    String r("HTTP/1.1 200 OK\r\nContent-Length: ");
+    r += (unsigned)path.length();
+    r += "\r\n\r\n";
+    r += path;
+    return r;
+  };
+  MockHttpsClient c;
+  setUp(c);
+  CHECK(c.beginGet("mock.local", 443, "/a"));
+  CHECK(c.pipelineGet("/bb"));
+  CHECK(c.pipelineGet("/ccc"));
+  const char* expect[] = {"/a", "/bb", "/ccc"};
+  for (int i = 0; i < 3; i++) {
+    if (i > 0) CHECK(c.nextPipelined());
+    run(c);
+    CHECK(c.done() && c.body() == expect[i]);
+  }
+  CHECK(c.pipelinePending() == 0);
+  CHECK(MockTransport::script().connects == 1 && MockTransport::script().requests == 3);
+}
+
+void staleSocketRetry() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done());
+  uint32_t requestBytes = c.timings().bytesOut;
+
+  // The server dropped the idle connection: sent again on a new one.
+  MockTransport::script().dropRequests = 1;
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && c.body() == "ok");
+  CHECK(MockTransport::script().connects == 2);
+  CHECK(!c.timings().reused && c.timings().newConnection);
+  CHECK(c.timings().bytesOut == requestBytes);
+
+  // Part of a status line arrived before the close: not replayed.
+  MockTransport::script().replies[0] = String("HTTP/1.1 2");
+  MockTransport::script().closeAfterResponse = true;
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.error() && MockTransport::script().connects == 2);
+  MockTransport::script().closeAfterResponse = false;
+  MockTransport::script().replies[0] = String("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done());
+
+  // A POST is never replayed.
+  MockTransport::script().dropRequests = 1;
+  c.beginPost("mock.local", 443, "/", String("x"));
+  run(c);
+  CHECK(c.error());
+}
+
+// Four GETs 6 s apart on one keep-alive client; returns the connects.
+uint32_t spacedGets(const char* response, uint32_t keepAliveIdleMs) {
+  fresh();
+  reply(response);
+  MockHttpsClient c;
+  setUp(c);
+  MockHttpsClient::Options opt;
+  opt.keepAlive = true;
+  opt.keepAliveIdleMs = keepAliveIdleMs;
+  c.setOptions(opt);
+  for (int i = 0; i < 4; i++) {
+    c.beginGet("mock.local", 443, "/");
+    run(c);
+    CHECK(c.done());
+    hostClock().nowMs += 6000;
+  }
+  return MockTransport::script().connects;
+}
+
+void keepAliveIdleWindow() {
+  const char* plain = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+  // No Keep-Alive header: kept until the server closes it.
+  CHECK(spacedGets(plain, 0) == 1);
+  // A window the caller assumes, or one the server announces.
+  CHECK(spacedGets(plain, 5000) == 4);
+  CHECK(spacedGets("HTTP/1.1 200 OK\r\nKeep-Alive: timeout=5\r\nContent-Length: 2\r\n\r\nok", 0) == 4);
+  CHECK(spacedGets("HTTP/1.1 200 OK\r\nKeep-Alive: timeout=10\r\nContent-Length: 2\r\n\r\nok", 0) == 1);
+}
+
+void hostSwitch() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  const char* hosts[] = {"a.local", "a.local", "b.local", "b.local"};
+  for (const char* h : hosts) {
+    c.beginGet(h, 443, "/");
+    run(c);
+    CHECK(c.done());
+  }
+  CHECK(MockTransport::script().connects == 2);
+  c.beginGet("b.local", 8443, "/");
+  run(c);
+  CHECK(MockTransport::script().connects == 3);
+}
+
+class StreamClient : public MockHttpsClient {
+public:
+  int parts = 0;
+  int onRequestBodyChunk(uint8_t* buf, size_t cap) override {
+    if (parts == 3) return END_OF_BODY;
+    parts++;
+    size_t n = min(cap, (size_t)4);
+    memcpy(buf, "abcd", n);
+    return (int)n;
+  }
+};
+
+void chunkedUpload() {
+  fresh();
+  String seen;
+  MockTransport::script().respond = [&seen](const String& req) {
+    seen = req;
+    return String("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+  };
+  MockTransport::script().writeChunk = 5;
+  StreamClient c;
+  setUp(c);
+  CHECK(c.beginPostStream("mock.local", 443, "/up"));
+  run(c);
+  CHECK(c.done() && c.status() == 200);
+  CHECK(MockTransport::script().requests == 1);
+  CHECK(seen.endsWith(String("4\r\nabcd\r\n4\r\nabcd\r\n4\r\nabcd\r\n0\r\n\r\n")));
+}
+
+void fullSendBuffer() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockTransport::script().writeRoom = 0;
+  MockHttpsClient c;
+  setUp(c);
+  CHECK(c.beginPost("mock.local", 443, "/", String("payload")));
+  for (int i = 0; i < 50; i++) {
+    c.poll();
+    hostClock().nowMs++;
+  }
+  // Nothing written while the transport has no room, and nothing failed.
+  CHECK(!c.done() && !c.error());
+  CHECK(c.timings().bytesOut == 0 && MockTransport::script().requests == 0);
+
+  MockTransport::script().writeRoom = -1;
+  run(c);
+  CHECK(c.done() && c.body() == "ok");
+}
+
+// One request with opt over a freshly scripted MockTransport.
+template <class Script>
+void deadlineCase(MockHttpsClient& c, const MockHttpsClient::Options& opt, Script script) {
+  fresh();
+  script(MockTransport::script());
+  setUp(c, false);
+  c.setOptions(opt);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+}
+
+void stageDeadlines() {
+  typedef MockHttpsClient C;
+  const String kilobytes = String("HTTP/1.1 200 OK\r\nContent-Length: 2000\r\n\r\n") +
+                           String(std::string(2000, 'x').c_str());
+  C::Options opt;
+  opt.timeoutMs = 0;
+
+  // Connect and handshake budgets, as the transport reports them.
+  {
+    C c;
+    deadlineCase(c, opt, [](MockTransport::Script& s) { s.tcpMs = 20000; });
+    CHECK(c.error() && c.errorMsg() == "connect timeout" && c.errorStage() == C::CONNECT);
+  }
+  {
+    C c;
+    deadlineCase(c, opt, [](MockTransport::Script& s) { s.tlsMs = 20000; });
+    CHECK(c.error() && c.errorMsg().startsWith("TLS handshake timeout") && c.errorStage() == C::CONNECT);
+  }
+  {
+    // Refused after 6 s: slow, but not a timeout.
+    C c;
+    deadlineCase(c, opt, [](MockTransport::Script& s) { s.tcpMs = 6000; s.failConnect = true; });
+    CHECK(c.error() && c.errorMsg().startsWith("connect/TLS failed") && c.errorStage() == C::CONNECT);
+  }
+
+  // First byte: off by default, so an 11 s answer fits the 15 s total.
+  {
+    C c;
+    deadlineCase(c, C::Options(), [&](MockTransport::Script& s) {
+      s.latencyMs = 11000;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.done() && c.body().length() == 2000);
+  }
+  {
+    C c;
+    C::Options o = opt;
+    o.firstByteTimeoutMs = 2000;
+    deadlineCase(c, o, [&](MockTransport::Script& s) {
+      s.latencyMs = 5000;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.error() && c.errorMsg() == "first byte timeout" && c.errorStage() == C::READ_HEADERS);
+  }
+
+  // Idle: opt in, then a 3 s stall mid-body or a send buffer that never drains.
+  C::Options idle = opt;
+  idle.idleTimeoutMs = 1000;
+  {
+    C c;
+    deadlineCase(c, idle, [&](MockTransport::Script& s) {
+      s.stallEveryBytes = 100;
+      s.stallMs = 3000;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.error() && c.errorMsg() == "idle timeout" && c.errorStage() == C::READ_BODY);
+  }
+  {
+    C c;
+    deadlineCase(c, idle, [&](MockTransport::Script& s) {
+      s.writeRoom = 0;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.error() && c.errorMsg() == "idle timeout" && c.errorStage() == C::SEND);
+  }
+  {
+    // Slow but progressing: 20 stalls of 500 ms, 10 s in all, never idle 1 s.
+    C c;
+    deadlineCase(c, idle, [&](MockTransport::Script& s) {
+      s.stallEveryBytes = 100;
+      s.stallMs = 500;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.done() && c.body().length() == 2000);
+    CHECK(hostClock().nowMs - 1000 > 10000);
+  }
+
+  // The overall timeoutMs still applies with every stage limit at 0.
+  {
+    C c;
+    C::Options o;
+    o.timeoutMs = 3000;
+    deadlineCase(c, o, [&](MockTransport::Script& s) {
+      s.latencyMs = 5000;
+      s.replies.push_back(kilobytes);
+    });
+    CHECK(c.error() && c.errorMsg() == "timeout" && c.errorStage() == C::READ_HEADERS);
+  }
+}
+
+// One keep-alive GET through the pool.
+void pooledGet(MockHttpsClient& c, const char* host) {
+  c.beginGet(host, 443, "/");
+  run(c);
+  CHECK(c.done() && c.body() == "ok");
+}
+
+void poolRotation() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsPool pool;
+  MockHttpsClient c;
+  setUp(c);
+  c.setPool(&pool);
+  // Three backends in turn fit the three slots: one connect each.
+  for (int round = 0; round < 3; round++) {
+    for (const char* h : {"a.local", "b.local", "c.local"}) pooledGet(c, h);
+  }
+  CHECK(pool.hits() == 6 && pool.misses() == 3 && pool.evictions() == 0);
+  CHECK(MockTransport::script().connects == 3);
+}
+
+void poolLimits() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockTransport::Script& script = MockTransport::script();
+  {
+    // LRU eviction: b is the least recently used when d needs a slot.
+    MockHttpsPool pool;
+    MockHttpsClient c;
+    setUp(c);
+    c.setPool(&pool);
+    for (const char* h : {"a.local", "b.local", "c.local", "a.local", "d.local"}) pooledGet(c, h);
+    CHECK(pool.hits() == 1 && pool.misses() == 4 && pool.evictions() == 1);
+    pooledGet(c, "a.local");
+    pooledGet(c, "c.local");
+    pooledGet(c, "d.local");
+    CHECK(pool.hits() == 4 && pool.misses() == 4);
+    pooledGet(c, "b.local");
+    CHECK(pool.misses() == 5 && pool.evictions() == 2);
+    CHECK(script.connects == 5);
+  }
+  {
+    // maxPerHost = 1: a second client waits for the first one's connection.
+    script.connects = 0;
+    MockHttpsPool pool;
+    MockHttpsClient c1, c2;
+    setUp(c1);
+    setUp(c2);
+    c1.setPool(&pool);
+    c2.setPool(&pool);
+    c1.beginGet("a.local", 443, "/");
+    c2.beginGet("a.local", 443, "/");
+    for (int i = 0; i < 1000 && !(c1.done() && c2.done()); i++) {
+      c1.poll();
+      c2.poll();
+      hostClock().nowMs++;
+    }
+    CHECK(c1.done() && c2.done());
+    CHECK(script.connects == 1 && pool.hits() == 1 && pool.misses() == 1);
+
+    MockHttpsPool::Options opt;
+    opt.maxPerHost = 2;
+    MockHttpsPool wide;
+    wide.setOptions(opt);
+    c1.setPool(&wide);
+    c2.setPool(&wide);
+    c1.beginGet("a.local", 443, "/");
+    c2.beginGet("a.local", 443, "/");
+    for (int i = 0; i < 1000 && !(c1.done() && c2.done()); i++) {
+      c1.poll();
+      c2.poll();
+      hostClock().nowMs++;
+    }
+    CHECK(c1.done() && c2.done());
+    CHECK(script.connects == 3 && wide.misses() == 2);
+  }
+  {
+    // trim() closes idle connections while the heap is below minFreeHeap.
+    MockHttpsPool pool;
+    MockHttpsPool::Options opt;
+    opt.minFreeHeap = 20000;
+    pool.setOptions(opt);
+    MockHttpsClient c;
+    setUp(c);
+    c.setPool(&pool);
+    pooledGet(c, "a.local");
+    pooledGet(c, "b.local");
+    pool.trim();
+    CHECK(pool.evictions() == 0);
+    ESP.freeHeap = 10000;
+    pool.trim();
+    ESP.freeHeap = UINT32_MAX;
+    CHECK(pool.evictions() == 2);
+    pooledGet(c, "a.local");
+    CHECK(pool.hits() == 0 && pool.misses() == 3);
+  }
+}
+
+void callerBodyBuffer() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 16\r\n\r\n0123456789abcdef");
+  reply("HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  uint8_t buf[8];
+  c.setBodyBuffer(buf, sizeof(buf));
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  // Truncated and flagged; the rest of the body is still read off the socket.
+  CHECK(c.done() && c.bodyOverflow());
+  CHECK(c.bodyLength() == 8 && memcmp(c.bodyData(), "01234567", 8) == 0);
+
+  c.setBodyBuffer(nullptr, 0);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && !c.bodyOverflow() && c.status() == 201 && c.body() == "ok");
+  CHECK(c.timings().reused && MockTransport::script().connects == 1);
+}
+
+void takeAndRecycleBody() {
+  fresh();
+  String reply2k = String("HTTP/1.1 200 OK\r\nContent-Length: 2000\r\n\r\n") +
+                   String(std::string(2000, 'x').c_str());
+  MockTransport::script().replies.push_back(reply2k);
+  MockHttpsClient c;
+  setUp(c);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  String first = c.takeBody();
+  CHECK(first.length() == 2000 && c.body().length() == 0);
+  const char* storage = first.c_str();
+
+  // The recycled allocation holds the next body and comes back out again.
+  c.recycleBody(std::move(first));
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  CHECK(c.done() && c.body().c_str() == storage);
+  String second = c.takeBody();
+  CHECK(second.length() == 2000 && second.c_str() == storage);
+}
+
+void warmState() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  MockHttpsClient::WarmState w;
+  CHECK(c.exportWarmState(w));
+
+  MockHttpsClient boot;
+  boot.setCACert("mock");
+  CHECK(boot.importWarmState(w, 60));
+  boot.beginGet("mock.local", 443, "/");
+  run(boot);
+  CHECK(boot.done() && boot.sessionResumed());
+
+  MockHttpsClient::WarmState bad = w;
+  bad.host[0] ^= 1;
+  MockHttpsClient cold;
+  cold.setCACert("mock");
+  CHECK(!cold.importWarmState(bad, 60));
+
+  // setCACert() clears the session cache, so the CA has to come first.
+  MockHttpsClient early;
+  CHECK(!early.importWarmState(w, 60));
+}
+
+// Boot side of warmStateAcrossProcesses(): a fresh process with no clock
+// set, as after deep sleep.
+int importWarmFile(const char* path) {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient::WarmState w;
+  FILE* f = fopen(path, "rb");
+  bool read = f && fread(&w, sizeof(w), 1, f) == 1;
+  if (f) fclose(f);
+  MockHttpsClient c;
+  c.setCACert("mock");
+  CHECK(read && c.importWarmState(w, 60));
+  CHECK(c.beginGet("mock.local", 443, "/"));  // needs the restored clock
+  run(c);
+  CHECK(c.done() && c.sessionResumed());
+  return gFailures ? 1 : 0;
+}
+
+void warmStateAcrossProcesses() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsClient c;
+  setUp(c);
+  c.beginGet("mock.local", 443, "/");
+  run(c);
+  MockHttpsClient::WarmState w;
+  CHECK(c.exportWarmState(w));
+
+  char path[] = "/tmp/ahc-warm-XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  if (fd < 0) return;
+  CHECK(write(fd, &w, sizeof(w)) == (ssize_t)sizeof(w));
+  close(fd);
+  String cmd(gSelf);
+  cmd += " --import-warm ";
+  cmd += path;
+  CHECK(system(cmd.c_str()) == 0);
+  unlink(path);
+}
+
+void scheduler() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockHttpsScheduler s;
+  s.setCACert("mock");
+  s.setUnixTime(1700000000);
+  int ok = 0, failed = 0;
+  for (int i = 0; i < 6; i++) {
+    MockHttpsScheduler::Request r;
+    r.host = i % 2 ? "a.local" : "b.local";
+    r.path = "/";
+    CHECK(s.enqueue(std::move(r), [&](uint32_t, MockHttpsClient* cl, const char* err) {
+      if (!err && cl && cl->status() == 200) ok++;
+      else failed++;
+    }) != 0);
+  }
+  for (int i = 0; i < 100000 && !s.idle(); i++) {
+    s.poll();
+    hostClock().nowMs++;
+  }
+  CHECK(ok == 6 && failed == 0);
+  CHECK(s.pool().hits() > 0);
+}
+
+void statistics() {
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  AsyncHttpsStats stats;
+  MockHttpsClient c;
+  setUp(c);
+  c.setStats(&stats);
+  for (int i = 0; i < 3; i++) {
+    c.beginGet("mock.local", 443, "/");
+    run(c);
+  }
+  const AsyncHttpsStats::HostStats* h = stats.find("mock.local");
+  CHECK(h && h->requests == 3 && h->connects == 1 && h->reused == 2);
+  CHECK(h && h->totalMs.count() == 3 && h->handshakeMs.count() == 1);
+
+  size_t need = stats.toBinary(nullptr, 0);
+  uint8_t buf[512];
+  memset(buf, 0xAA, sizeof(buf));
+  CHECK(need > 8 && need <= sizeof(buf));
+  CHECK(stats.toBinary(buf, need - 1) == need && buf[0] == 0xAA);  // too small: untouched
+  CHECK(stats.toBinary(buf, sizeof(buf)) == need && memcmp(buf, "AHS\1", 4) == 0);
+  char text[4096];
+  size_t len = stats.toPrometheus(text, sizeof(text));
+  CHECK(len < sizeof(text) && strlen(text) == len);
+  CHECK(strstr(text, "ahc_requests_total{host=\"mock.local\"} 3\n") != nullptr);
+
+  // A request the scheduler kills at its deadline is counted as a failure.
+  fresh();
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  MockTransport::script().latencyMs = 500;
+  AsyncHttpsStats schedStats;
+  MockHttpsScheduler s;
+  s.setCACert("mock");
+  s.setUnixTime(1700000000);
+  s.setStats(&schedStats);
+  MockHttpsScheduler::Request r;
+  r.host = "slow.local";
+  r.path = "/";
+  r.deadlineMs = 100;
+  String error;
+  s.enqueue(std::move(r), [&](uint32_t, MockHttpsClient* cl, const char* err) {
+    error = err ? err : "";
+    CHECK(cl && cl->error() && cl->errorStage() == MockHttpsClient::READ_HEADERS);
+  });
+  for (int i = 0; i < 100000 && !s.idle(); i++) {
+    s.poll();
+    hostClock().nowMs++;
+  }
+  h = schedStats.find("slow.local");
+  CHECK(error == "deadline exceeded");
+  CHECK(h && h->requests == 1 && h->failures[MockHttpsClient::READ_HEADERS] == 1);
+}
+
+struct Test {
+  const char* name;
+  void (*fn)();
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  gSelf = argv[0];
+  if (argc == 3 && !strcmp(argv[1], "--import-warm")) return importWarmFile(argv[2]);
+  const Test tests[] = {
+      {"chunked body with extensions and trailers", chunkedWithTrailers},
+      {"1xx, 204 and HEAD", interimAndBodiless},
+      {"pipelined GETs", pipelining},
+      {"stale keep-alive socket retry", staleSocketRetry},
+      {"keep-alive idle window", keepAliveIdleWindow},
+      {"keep-alive socket is per host:port", hostSwitch},
+      {"chunked request body", chunkedUpload},
+      {"no write while the send buffer is full", fullSendBuffer},
+      {"per-stage deadlines", stageDeadlines},
+      {"connection pool, three-host rotation", poolRotation},
+      {"connection pool LRU, maxPerHost and trim()", poolLimits},
+      {"caller body buffer overflow", callerBodyBuffer},
+      {"takeBody() and recycleBody()", takeAndRecycleBody},
+      {"warm state", warmState},
+      {"warm state through a file, second process", warmStateAcrossProcesses},
+      {"scheduler", scheduler},
+      {"statistics", statistics},
+  };
+  int failedGroups = 0;
+  for (const Test& t : tests) {
+    int before = gFailures;
+    t.fn();
+    printf("%s %s\n", gFailures == before ? "ok  " : "FAIL", t.name);
+    if (gFailures != before) failedGroups++;
+  }
+  printf("%d of %zu groups failed\n", failedGroups, sizeof(tests) / sizeof(tests[0]));
+  return failedGroups ? 1 : 0;
+}